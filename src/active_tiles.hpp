@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace dtks{
+
+    // coarse occupancy mask of an image: which tile_size x tile_size tiles may hold
+    // non zero values. Tiles are either active because they were written to
+    // (activate) or because they are persistent (e.g. they contain sources).
+    // Operations which map zero to zero only have to visit the active tiles and the
+    // tiles within their reach, see gaussianSeparableWrapFused.
+    class ActiveTiles
+    {
+        public:
+
+        ActiveTiles() = default;
+
+        ActiveTiles(std::array<int, 2> shape, int tile_size)
+        :   tile_size_(tile_size),
+            n_tiles_{(shape[0] + tile_size - 1) / tile_size, (shape[1] + tile_size - 1) / tile_size},
+            active_(std::size_t(n_tiles_[0]) * std::size_t(n_tiles_[1]), 0),
+            persistent_(active_.size(), 0)
+        {
+        }
+
+        bool empty() const
+        {
+            return active_.empty();
+        }
+
+        int tile_size() const
+        {
+            return tile_size_;
+        }
+
+        const std::array<int, 2> & n_tiles() const
+        {
+            return n_tiles_;
+        }
+
+        std::size_t size() const
+        {
+            return active_.size();
+        }
+
+        inline std::size_t tile_index(int x, int y) const
+        {
+            return std::size_t(y / tile_size_) * std::size_t(n_tiles_[0]) + std::size_t(x / tile_size_);
+        }
+
+        inline bool active(std::size_t tile) const
+        {
+            return active_[tile] != 0;
+        }
+
+        inline void activate(int x, int y)
+        {
+            active_[tile_index(x, y)] = 1;
+        }
+
+        void activate_all()
+        {
+            std::fill(active_.begin(), active_.end(), std::uint8_t(1));
+        }
+
+        void set_persistent(int x, int y)
+        {
+            persistent_[tile_index(x, y)] = 1;
+            activate(x, y);
+        }
+
+        void clear_persistent()
+        {
+            std::fill(persistent_.begin(), persistent_.end(), std::uint8_t(0));
+        }
+
+        std::size_t n_active() const
+        {
+            return std::size_t(std::count(active_.begin(), active_.end(), std::uint8_t(1)));
+        }
+
+        // the active tiles and all tiles at most `reach` tiles away from one (periodic)
+        std::vector<std::uint8_t> dilated(int reach) const
+        {
+            if(reach == 0)
+            {
+                return active_;
+            }
+            std::vector<std::uint8_t> result(active_.size(), 0);
+            for(int ty = 0; ty < n_tiles_[1]; ++ty)
+            {
+                for(int tx = 0; tx < n_tiles_[0]; ++tx)
+                {
+                    if(!active_[std::size_t(ty) * n_tiles_[0] + tx])
+                    {
+                        continue;
+                    }
+                    for(int dy = -reach; dy <= reach; ++dy)
+                    {
+                        const int ny = ((ty + dy) % n_tiles_[1] + n_tiles_[1]) % n_tiles_[1];
+                        for(int dx = -reach; dx <= reach; ++dx)
+                        {
+                            const int nx = ((tx + dx) % n_tiles_[0] + n_tiles_[0]) % n_tiles_[0];
+                            result[std::size_t(ny) * n_tiles_[0] + nx] = 1;
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        // replace the active set by the given tiles plus the persistent ones
+        void assign(const std::vector<std::uint8_t> & non_zero)
+        {
+            for(std::size_t i = 0; i < active_.size(); ++i)
+            {
+                active_[i] = non_zero[i] | persistent_[i];
+            }
+        }
+
+        private:
+        int tile_size_ = 0;
+        std::array<int, 2> n_tiles_ = {0, 0};
+        std::vector<std::uint8_t> active_;
+        std::vector<std::uint8_t> persistent_;
+    };
+
+} // namespace dtks
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace dtks{
+
+    // process wide switch, off by default: allocations of AlignedAllocator of at
+    // least huge_page_size bytes are advised to use transparent huge pages
+    // (madvise(MADV_HUGEPAGE), Linux only), which saves TLB misses when sweeping
+    // over large images
+    inline std::atomic<bool> & huge_pages_flag()
+    {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+
+    inline void enable_huge_pages(bool enable = true)
+    {
+        huge_pages_flag().store(enable, std::memory_order_relaxed);
+    }
+
+    inline bool huge_pages_enabled()
+    {
+        return huge_pages_flag().load(std::memory_order_relaxed);
+    }
+
+    // allocator for the pixel storage: ALIGNMENT byte aligned (a cache line by default,
+    // so rows start on one and vector loads do not split), allocations of
+    // huge_page_size bytes or more are aligned to huge_page_size so they can be
+    // backed by huge pages
+    template<class T, std::size_t ALIGNMENT = 64>
+    struct AlignedAllocator
+    {
+        using value_type = T;
+        static constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+        template<class U>
+        struct rebind
+        {
+            using other = AlignedAllocator<U, ALIGNMENT>;
+        };
+
+        AlignedAllocator() = default;
+
+        template<class U>
+        AlignedAllocator(const AlignedAllocator<U, ALIGNMENT> &) noexcept
+        {
+        }
+
+        T * allocate(std::size_t n)
+        {
+            const auto bytes = n * sizeof(T);
+            void * p = ::operator new(bytes, std::align_val_t(alignment(bytes)));
+        #ifdef __linux__
+            if(bytes >= huge_page_size && huge_pages_enabled())
+            {
+                // only a hint, failure is harmless
+                madvise(p, bytes, MADV_HUGEPAGE);
+            }
+        #endif
+            return static_cast<T *>(p);
+        }
+
+        void deallocate(T * p, std::size_t n) noexcept
+        {
+            ::operator delete(p, std::align_val_t(alignment(n * sizeof(T))));
+        }
+
+        static constexpr std::size_t alignment(std::size_t bytes)
+        {
+            return bytes >= huge_page_size ? huge_page_size : std::max(ALIGNMENT, alignof(T));
+        }
+
+        template<class U>
+        bool operator==(const AlignedAllocator<U, ALIGNMENT> &) const noexcept
+        {
+            return true;
+        }
+    };
+
+} // namespace dtks
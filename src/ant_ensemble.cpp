@@ -0,0 +1,82 @@
+#include <stdexcept>
+#include "ant_ensemble.hpp"
+
+namespace dtks{
+
+    AntEnsemble::AntEnsemble(const std::vector<Parameters> & params, std::size_t n_threads)
+    :   thread_pool_(std::make_unique<ThreadPool>(n_threads))
+    {
+        simulations_.reserve(params.size());
+        for(auto p : params)
+        {
+            // the ensemble already uses all threads, a member must not start
+            // a pool of its own for the parallel ant update
+            p.n_threads = 1;
+            simulations_.emplace_back(p);
+        }
+    }
+
+    std::size_t AntEnsemble::size() const
+    {
+        return simulations_.size();
+    }
+
+    AntSimulation & AntEnsemble::simulation(std::size_t i)
+    {
+        if(i >= simulations_.size())
+        {
+            throw std::out_of_range("simulation index out of range");
+        }
+        return simulations_[i];
+    }
+
+    void AntEnsemble::throw_if_running() const
+    {
+        for(const auto & simulation : simulations_)
+        {
+            simulation.throw_if_running();
+        }
+    }
+
+    void AntEnsemble::ready()
+    {
+        throw_if_running();
+        thread_pool_->parallel_for(0, simulations_.size(), 1, [&](std::size_t begin, std::size_t end)
+        {
+            for(auto i = begin; i < end; ++i)
+            {
+                simulations_[i].ready();
+            }
+        });
+    }
+
+    void AntEnsemble::run(std::size_t n_steps)
+    {
+        throw_if_running();
+        // grain 1: the simulations are handed out one by one, which balances
+        // runs with different costs (n_ants, shape, ...) across the threads.
+        // each simulation does all its steps in one go to keep its maps in cache
+        thread_pool_->parallel_for(0, simulations_.size(), 1, [&](std::size_t begin, std::size_t end)
+        {
+            for(auto i = begin; i < end; ++i)
+            {
+                for(std::size_t s = 0; s < n_steps; ++s)
+                {
+                    simulations_[i].step();
+                }
+            }
+        });
+    }
+
+    std::vector<std::array<std::size_t, 2>> AntEnsemble::metrics() const
+    {
+        throw_if_running();
+        std::vector<std::array<std::size_t, 2>> result(simulations_.size());
+        for(std::size_t i = 0; i < simulations_.size(); ++i)
+        {
+            result[i] = {simulations_[i].food_collected(), simulations_[i].food_at_nest()};
+        }
+        return result;
+    }
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include "ants.hpp"
+#include "thread_pool.hpp"
+
+namespace dtks{
+
+    // many independent AntSimulations, e.g. for parameter sweeps.
+    // The simulations are stepped in parallel, one simulation per task, so
+    // each of them runs serially on one thread at a time and results are the
+    // same as stepping them one after another. The members run with n_threads = 1,
+    // the parallel ant update gives the same results with any n_threads.
+    // ready(), run() and metrics() throw while a member runs in the background
+    class AntEnsemble
+    {
+        public:
+
+        // n_threads counts the calling thread, 0 means all cores
+        AntEnsemble(const std::vector<Parameters> & params, std::size_t n_threads = 0);
+
+        std::size_t size() const;
+        AntSimulation & simulation(std::size_t i);
+
+        // calls ready() on every simulation, after the maps have been set up
+        void ready();
+
+        // advances every simulation by n_steps
+        void run(std::size_t n_steps);
+
+        // {food_collected, food_at_nest} of every simulation
+        std::vector<std::array<std::size_t, 2>> metrics() const;
+
+        private:
+        void throw_if_running() const;
+
+        std::vector<AntSimulation> simulations_;
+        std::unique_ptr<ThreadPool> thread_pool_;
+    };
+
+}
@@ -1,4 +1,11 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 #include <format>
 #include <random>
@@ -14,86 +21,433 @@ namespace dtks{
         return degrees * M_PI / 180.0f;
     }
 
+    namespace
+    {
+        template<class T>
+        using PheromonePair = TinyVector<T, 2>;
+
+        // all zero pheromone map of the selected scalar type with pixels PIXEL<scalar>
+        template<class MAP, template<class> class PIXEL>
+        MAP zero_pheromone_map(const Parameters & params)
+        {
+            switch(params.pheromone_type)
+            {
+                case PheromoneType::float32:
+                    return MAP(Image2d<PIXEL<float>>(params.shape, PIXEL<float>()));
+                case PheromoneType::float16:
+                    return MAP(Image2d<PIXEL<Half>>(params.shape, PIXEL<Half>()));
+                default:
+                    return MAP(Image2d<PIXEL<double>>(params.shape, PIXEL<double>()));
+            }
+        }
+
+        template<class T>
+        struct is_world_cell : std::false_type
+        {
+        };
+
+        template<class T>
+        struct is_world_cell<WorldCell<T>> : std::true_type
+        {
+        };
+
+        template<class MAP>
+        constexpr bool is_packed_map = is_world_cell<typename MAP::value_type>::value;
+
+        template<class T>
+        struct pheromone_compute_type
+        {
+            using type = float;
+        };
+
+        template<>
+        struct pheromone_compute_type<double>
+        {
+            using type = double;
+        };
+
+        constexpr std::size_t sense_block_size = 64;
+
+        // branch free sin / cos which the compiler can vectorize over a block of ants.
+        // Cody-Waite reduction to [-pi/4, pi/4] and the cephes minimax polynomials,
+        // within a few ulp of std::sin / std::cos
+        inline void fast_sincos(float x, float & s, float & c)
+        {
+            // angles accumulate turns without bound, reduce them to [-pi, pi] in double first
+            const double two_pi = 6.283185307179586;
+            const float a = float(double(x) - two_pi * std::floor(double(x) / two_pi + 0.5));
+            // a = j * pi / 2 + r
+            const float j = std::floor(a * 0.63661977236758134f + 0.5f);
+            const float r = ((a - j * 1.5703125f) - j * 4.8375129699707031e-4f) - j * 7.5497899548918822e-8f;
+            const float r2 = r * r;
+            const float sin_r = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+            const float cos_r = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+            const int quadrant = int(j) & 3;
+            s = (quadrant & 1) ? cos_r : sin_r;
+            c = (quadrant & 1) ? sin_r : cos_r;
+            s = quadrant >= 2 ? -s : s;
+            c = (quadrant == 1 || quadrant == 2) ? -c : c;
+        }
+
+        // std::lround, but without the libm call so that it vectorizes
+        inline int round_half_away(float v)
+        {
+            const double d = v;
+            return int(d < 0.0 ? -std::floor(0.5 - d) : std::floor(d + 0.5));
+        }
+
+        inline int wrap_coordinate(int v, int n)
+        {
+            v = v < 0 ? v + n : v;
+            return v >= n ? v - n : v;
+        }
+    }
+
 
 
     AntSimulation::AntSimulation(Parameters params) : 
         params_(params),
         ants_(params_.n_ants),
-        pheromone_map_(params_.shape, {0.0, 0.0}),
-        temp_pheromone_map_(params_.shape, {0.0, 0.0}),
+        pheromone_map_(
+            params_.world_layout == WorldLayout::packed ?
+            zero_pheromone_map<PheromoneMap, WorldCell>(params_) :
+            zero_pheromone_map<PheromoneMap, PheromonePair>(params_)
+        ),
         is_land_(params_.shape, 1),
         food_map_(params_.shape, 0),
         nest_map_(params_.shape, 0),
         nest_positions_(),
         generator_(params_.seed),
-        direction_change_dist_(-0.1f, 0.1f)
+        direction_change_dist_(-0.1f, 0.1f),
+        thread_pool_(params_.parallel_ant_update && params_.n_threads != 1 ? std::make_unique<ThreadPool>(params_.n_threads) : nullptr)
     {
-
+        if(params_.pheromone_tile_size > 0)
+        {
+            pheromone_tiles_ = ActiveTiles(params_.shape, params_.pheromone_tile_size);
+        }
+        // all land without food or nest, so step() works before ready()
+        update_cell_flags();
     }
 
 
+    struct AntSimulation::AsyncStepping
+    {
+        std::thread thread;
+        std::atomic<bool> stop_requested{false};
+        std::exception_ptr error;
+        // step_count_ of the background thread, for step_count() while running
+        std::atomic<std::size_t> step{0};
+        // the latest published snapshot
+        std::mutex mutex;
+        std::shared_ptr<const AntSnapshot> front;
+    };
+
+    AntSimulation::AntSimulation(AntSimulation &&) = default;
+    AntSimulation & AntSimulation::operator=(AntSimulation &&) = default;
+
+    AntSimulation::~AntSimulation()
+    {
+        if(running())
+        {
+            async_->stop_requested = true;
+            async_->thread.join();
+        }
+    }
+
     const Parameters& AntSimulation::parameters() const { return params_; }
 
     void AntSimulation::step()
     {
+        throw_if_running();
+        advance();
+    }
+
+    void AntSimulation::run(std::size_t n_steps)
+    {
+        throw_if_running();
+        for(std::size_t i = 0; i < n_steps; ++i)
+        {
+            advance();
+        }
+    }
+
+    void AntSimulation::advance()
+    {
+        std::visit([&](auto & pheromone_map){ step_impl(pheromone_map); }, pheromone_map_);
+    }
+
+    void AntSimulation::throw_if_running() const
+    {
+        if(running())
+        {
+            throw std::runtime_error("the simulation is running in the background, call stop() first");
+        }
+    }
+
+    std::size_t AntSimulation::step_count() const
+    {
+        return running() ? async_->step.load(std::memory_order_relaxed) : step_count_;
+    }
+
+    bool AntSimulation::running() const
+    {
+        return async_ && async_->thread.joinable();
+    }
+
+    void AntSimulation::start(std::size_t snapshot_interval)
+    {
+        throw_if_running();
+        if(!async_)
+        {
+            async_ = std::make_unique<AsyncStepping>();
+        }
+        async_->stop_requested = false;
+        async_->error = nullptr;
+        async_->step = step_count_;
+        publish_snapshot();
+        const auto interval = std::max<std::size_t>(snapshot_interval, 1);
+        async_->thread = std::thread([this, interval]
+        {
+            try
+            {
+                for(std::size_t i = 1; !async_->stop_requested.load(std::memory_order_relaxed); ++i)
+                {
+                    advance();
+                    async_->step.store(step_count_, std::memory_order_relaxed);
+                    if(i % interval == 0)
+                    {
+                        publish_snapshot();
+                    }
+                }
+            }
+            catch(...)
+            {
+                async_->error = std::current_exception();
+            }
+        });
+    }
+
+    void AntSimulation::stop()
+    {
+        if(!running())
+        {
+            return;
+        }
+        async_->stop_requested = true;
+        async_->thread.join();
+        publish_snapshot();
+        if(async_->error)
+        {
+            std::rethrow_exception(std::exchange(async_->error, nullptr));
+        }
+    }
+
+    std::shared_ptr<const AntSnapshot> AntSimulation::snapshot() const
+    {
+        if(running())
+        {
+            std::lock_guard<std::mutex> lock(async_->mutex);
+            return async_->front;
+        }
+        auto snapshot = std::make_shared<AntSnapshot>();
+        copy_snapshot(*snapshot);
+        return snapshot;
+    }
+
+    void AntSimulation::copy_snapshot(AntSnapshot & snapshot) const
+    {
+        snapshot.step = step_count_;
+        snapshot.food_collected = food_collected_;
+        snapshot.food_at_nest = food_at_nest_;
+        snapshot.ants = ants_;
+        std::visit([&](const auto & pheromone_map)
+        {
+            using pixel_type = typename std::decay_t<decltype(pheromone_map)>::value_type;
+            using scalar = typename scalar_type<pixel_type>::type;
+            snapshot.pheromones.resize(pheromone_map.size() * sizeof(pixel_type));
+            std::memcpy(snapshot.pheromones.data(), pheromone_map.data(), snapshot.pheromones.size());
+            snapshot.pixel_stride = sizeof(pixel_type) / sizeof(scalar);
+        }, pheromone_map_);
+        snapshot.pheromone_type = params_.pheromone_type;
+    }
+
+    void AntSimulation::publish_snapshot()
+    {
+        // always a new snapshot: readers may hold on to the previous one for as long
+        // as they like, it is freed once the last of them drops it
+        auto snapshot = std::make_shared<AntSnapshot>();
+        copy_snapshot(*snapshot);
+        // declared before the lock, so the old snapshot is freed after unlocking
+        std::shared_ptr<const AntSnapshot> previous;
+        std::lock_guard<std::mutex> lock(async_->mutex);
+        previous = std::exchange(async_->front, std::move(snapshot));
+    }
+
+    template<class MAP>
+    void AntSimulation::step_impl(MAP & pheromone_map)
+    {
+        using T = typename scalar_type<typename MAP::value_type>::type;
+        using C = typename pheromone_compute_type<T>::type;
+
         // Simulation step logic goes here
-        for(auto & ant : ants_)
+        if(params_.parallel_ant_update)
         {
-            
-            // update pos
-            update_ant_pos(ant);
+            update_ants_parallel(pheromone_map);
+        }
+        else
+        {
+            for(auto & ant : ants_)
+            {
+                
+                // update pos
+                if(move_ant(ant, generator_, pheromone_map))
+                {
+                    ant_arrived(ant, pheromone_map);
+                }
 
-            // drop pheromone at last position
-            pheromone_map_[ant.grid_position][int(ant.carrying_food)] += params_.pheromone_deposit_amount * ant.pheromone_drop_multiplier;
+                // drop pheromone at last position
+                deposit_pheromone(ant, pheromone_map);
+            }
         }
-        nest_and_food_emit();
+        ++step_count_;
+
+        emit(pheromone_map);
 
-        if(params_.sigma_diffusion > 0.0001f)
+        // diffuse and evaporate in one sweep over the map,
+        // skipping the all zero tiles away from trails and sources
+        const auto evaporation = 1.0f - params_.pheromone_evaporation_rate;
+        auto pre = [&](int, int, const typename MAP::value_type & phero)
         {
-            // diffuse pheromones
-            gaussianSeparableWrap(
-                pheromone_map_,
-                temp_pheromone_map_,
-                pheromone_map_,
-                1,
-                params_.sigma_diffusion
-            );
+            return TinyVector<C, 2>{C(phero[0]), C(phero[1])};
+        };
+        auto post = [&](TinyVector<C, 2> phero, typename MAP::value_type pixel)
+        {
+            for(std::size_t c = 0; c < 2; ++c)
+            {
+                phero[c] *= evaporation;
+                if(phero[c] < params_.pheromone_truncation_threshold){
+                    phero[c] = 0.0f;
+                }
+                // keeps the flags of the packed layout
+                pixel[c] = T(phero[c]);
+            }
+            return pixel;
+        };
+        auto tiles = pheromone_tiles_.empty() ? nullptr : &pheromone_tiles_;
+        const double sigma = params_.sigma_diffusion;
+        if(sigma >= params_.box_diffusion_sigma)
+        {
+            // wide diffusion, the box filters cost the same for any sigma
+            gaussianBoxWrapFused(pheromone_map, sigma, pre, post, tiles, thread_pool_.get());
         }
-        //evaporate pheromones
-        //pheromone_map_ *= (1.0f - params_.pheromone_evaporation_rate);
-        auto ptr = reinterpret_cast<double*>(pheromone_map_.data());
-        for(std::size_t i = 0; i < pheromone_map_.size() * 2; ++i)
+        else
         {
-            ptr[i] *= (1.0f - params_.pheromone_evaporation_rate);
-            if(ptr[i] < params_.pheromone_truncation_threshold){
-                ptr[i] = 0.0f;
-            }                    
+            // the kernel covers +- 3 sigma
+            const std::size_t radius = sigma > 0.0001 ? std::max(1L, std::lround(3.0 * sigma)) : 0;
+            gaussianSeparableWrapFused(pheromone_map, radius, sigma, pre, post, tiles, thread_pool_.get());
         }
 
     }
 
-    void AntSimulation::nest_and_food_emit()
+    template<class MAP>
+    void AntSimulation::emit(MAP & pheromone_map)
     {
+        using T = typename scalar_type<typename MAP::value_type>::type;
+        const T amount(params_.nest_pheromone_deposit_amount);
+
+        // drop the food pixels eaten up since the last step
+        if(food_depleted_)
+        {
+            food_pixels_.erase(
+                std::remove_if(food_pixels_.begin(), food_pixels_.end(), [&](std::uint32_t i){ return food_map_[i] == 0; }),
+                food_pixels_.end()
+            );
+            food_depleted_ = false;
+        }
+
         for(auto nest_pos : nest_positions_)
         {
-            pheromone_map_[nest_pos][0] = params_.nest_pheromone_deposit_amount;
+            pheromone_map[nest_pos][0] = amount;
+        }
+        for(auto i : food_pixels_)
+        {
+            pheromone_map[i][1] = amount;
         }
-        for(auto i=0; i<food_map_.size(); ++i)
+        for(auto i : water_pixels_)
         {
-            auto & phero = pheromone_map_[i];
-            if(food_map_[i] > 0)
+            pheromone_map[i][0] = T(0.0f);
+            pheromone_map[i][1] = T(0.0f);
+        }
+    }
+
+    template<class MAP>
+    void AntSimulation::update_ants_parallel(MAP & pheromone_map)
+    {
+        // sensing and moving only read the maps, so all ants move in parallel
+        // on the state of the maps at the start of the step. Each ant draws
+        // from its own philox stream keyed by (seed, step, ant), which makes
+        // the result independent of how the ants are split across threads
+        const auto n_ants = ants_.size();
+        moved_.resize(n_ants);
+        auto move_chunk = [&](std::size_t begin, std::size_t end)
+        {
+            AntSenses senses[sense_block_size];
+            for(auto block_begin = begin; block_begin < end; block_begin += sense_block_size)
             {
-                phero[1] = params_.nest_pheromone_deposit_amount;
+                const auto n = std::min(sense_block_size, end - block_begin);
+                sense_block(ants_.data() + block_begin, n, pheromone_map, senses);
+                for(std::size_t k = 0; k < n; ++k)
+                {
+                    const auto i = block_begin + k;
+                    Philox4x32 generator(std::uint64_t(params_.seed), step_count_, std::uint32_t(i));
+                    moved_[i] = steer_and_step(ants_[i], senses[k], generator);
+                }
             }
-            if(is_land_[i] == 0)
+        };
+        if(thread_pool_)
+        {
+            thread_pool_->parallel_for(0, n_ants, move_chunk);
+        }
+        else
+        {
+            move_chunk(0, n_ants);
+        }
+
+        // food pick up, the counters and the deposits write shared state. They are
+        // applied in ant order, so with finite food the first ants get the last
+        // pieces, and the floating point sums do not depend on the thread count
+        for(std::size_t i = 0; i < n_ants; ++i)
+        {
+            if(moved_[i])
             {
-                phero[0] = 0.0f;
-                phero[1] = 0.0f;
+                ant_arrived(ants_[i], pheromone_map);
             }
+            deposit_pheromone(ants_[i], pheromone_map);
         }
     }
 
     void AntSimulation::update_ant_pos(Ant & ant)
+    {
+        throw_if_running();
+        std::visit([&](auto & pheromone_map)
+        {
+            if(move_ant(ant, generator_, pheromone_map))
+            {
+                ant_arrived(ant, pheromone_map);
+            }
+        }, pheromone_map_);
+    }
+
+    template<class RNG, class MAP>
+    bool AntSimulation::move_ant(Ant & ant, RNG & generator, const MAP & pheromone_map)
+    {
+        AntSenses senses;
+        sense(ant, pheromone_map, senses);
+        return steer_and_step(ant, senses, generator);
+    }
+
+    template<class MAP>
+    void AntSimulation::sense(const Ant & ant, const MAP & pheromone_map, AntSenses & senses) const
     {   
         // randomly change direction a bit
 
@@ -104,19 +458,18 @@ namespace dtks{
         constexpr std::size_t n_directions = 3;
 
         TinyVector<float, n_directions>   angles = {0.0f, -params_.sense_angle, params_.sense_angle};
-        TinyVector<float, n_directions>   pheromones;
+        auto & pheromones = senses.pheromones;
         TinyVector<uint8_t, n_directions> land_at_distance;
-        TinyVector<uint8_t, n_directions> land_nh;
-        TinyVector<float, n_directions>    probabilities;
+        auto & land_nh = senses.land_nh;
 
         // with food, look for home,
         // without food, look for food
-        bool any_target = false;
-        int target_index = 0;
+        auto & any_target = senses.any_target;
+        auto & target_index = senses.target_index;
         TinyVector<uint8_t, n_directions> is_target(0);
 
-        std::size_t is_land_nh_count = 0;
-        std::size_t is_land_at_distance_count = 0;
+        auto & is_land_nh_count = senses.land_nh_count;
+        auto & is_land_at_distance_count = senses.land_at_distance_count;
         for(std::size_t i = 0; i < n_directions; ++i)
         {
             float sense_angle = ant.direction + angles[i];
@@ -126,12 +479,28 @@ namespace dtks{
             float nh_y = ant.position[1] + sin(sense_angle);
             auto nh_xy = round_and_wrap({nh_x, nh_y});
             auto sense_xy = round_and_wrap({sense_x, sense_y});
-            auto pheromone = pheromone_map_(sense_xy[0], sense_xy[1])[int(!ant.carrying_food)];
-
-
+            float pheromone = pheromone_map(sense_xy[0], sense_xy[1])[int(!ant.carrying_food)];
 
+            if constexpr(is_packed_map<MAP>)
+            {
+                // everything is in the record of the pixel
+                const auto flags = pheromone_map(sense_xy[0], sense_xy[1]).flags;
+                const std::uint8_t is_land = (flags & cell_land) ? 1 : 0;
+                const std::uint8_t is_land_nh = (pheromone_map(nh_xy[0], nh_xy[1]).flags & cell_land) ? 1 : 0;
+                is_land_at_distance_count += is_land;
+                is_land_nh_count += is_land_nh;
+                if(flags & (ant.carrying_food ? cell_nest : cell_food))
+                {
+                    is_target[i] = 1;
+                    any_target = true;
+                    target_index = i;
+                }
+                land_nh[i] = is_land_nh;
+                pheromones[i] = pheromone;
+                land_at_distance[i] = is_land;
+                continue;
+            }
 
-            
             auto is_land = is_land_(sense_xy[0], sense_xy[1]);
             auto is_land_nh = is_land_(nh_xy[0], nh_xy[1]);
             is_land_at_distance_count += is_land;
@@ -162,6 +531,82 @@ namespace dtks{
             pheromones[i] = pheromone;
             land_at_distance[i] = is_land;
         }
+    }
+
+    template<class MAP>
+    void AntSimulation::sense_block(const Ant * ants, std::size_t n, const MAP & pheromone_map, AntSenses * senses) const
+    {
+        constexpr std::size_t n_directions = 3;
+        const float angles[n_directions] = {0.0f, -params_.sense_angle, params_.sense_angle};
+        const float sense_distance = float(params_.sense_distance);
+        const int width = params_.shape[0];
+        const int height = params_.shape[1];
+
+        // the sense positions of all ants in the block, computed on
+        // structure of arrays copies so the loops vectorize
+        float x[sense_block_size];
+        float y[sense_block_size];
+        float direction[sense_block_size];
+        std::uint32_t sense_index[n_directions][sense_block_size];
+        std::uint32_t nh_index[n_directions][sense_block_size];
+        for(std::size_t k = 0; k < n; ++k)
+        {
+            x[k] = ants[k].position[0];
+            y[k] = ants[k].position[1];
+            direction[k] = ants[k].direction;
+        }
+        for(std::size_t d = 0; d < n_directions; ++d)
+        {
+            for(std::size_t k = 0; k < n; ++k)
+            {
+                float s, c;
+                fast_sincos(direction[k] + angles[d], s, c);
+                const int sense_x = wrap_coordinate(round_half_away(x[k] + sense_distance * c), width);
+                const int sense_y = wrap_coordinate(round_half_away(y[k] + sense_distance * s), height);
+                const int nh_x = wrap_coordinate(round_half_away(x[k] + c), width);
+                const int nh_y = wrap_coordinate(round_half_away(y[k] + s), height);
+                sense_index[d][k] = std::uint32_t(sense_y * width + sense_x);
+                nh_index[d][k] = std::uint32_t(nh_y * width + nh_x);
+            }
+        }
+
+        // one flag load per position plus the pheromone
+        for(std::size_t k = 0; k < n; ++k)
+        {
+            auto & ant_senses = senses[k];
+            ant_senses = AntSenses();
+            const int channel = int(!ants[k].carrying_food);
+            const std::uint8_t target = ants[k].carrying_food ? cell_nest : cell_food;
+            for(std::size_t d = 0; d < n_directions; ++d)
+            {
+                const auto flags = cell_flags(pheromone_map, sense_index[d][k]);
+                const std::uint8_t land = (flags & cell_land) ? 1 : 0;
+                const std::uint8_t land_nh = (cell_flags(pheromone_map, nh_index[d][k]) & cell_land) ? 1 : 0;
+                ant_senses.land_at_distance_count += land;
+                ant_senses.land_nh_count += land_nh;
+                if(flags & target)
+                {
+                    ant_senses.any_target = true;
+                    ant_senses.target_index = int(d);
+                }
+                ant_senses.land_nh[d] = land_nh;
+                ant_senses.pheromones[d] = float(pheromone_map[sense_index[d][k]][channel]);
+            }
+        }
+    }
+
+    template<class RNG>
+    bool AntSimulation::steer_and_step(Ant & ant, const AntSenses & senses, RNG & generator)
+    {
+        constexpr std::size_t n_directions = 3;
+        TinyVector<float, n_directions> pheromones = senses.pheromones;
+        const auto & land_nh = senses.land_nh;
+        TinyVector<float, n_directions> probabilities;
+        const auto any_target = senses.any_target;
+        const auto target_index = senses.target_index;
+        const auto is_land_nh_count = senses.land_nh_count;
+        const auto is_land_at_distance_count = senses.land_at_distance_count;
+
         //std::cout<<"is_land_nh_count: "<<is_land_nh_count<<" is_land_at_distance_count: "<<is_land_at_distance_count<<"\n";
         ant.pheromone_drop_multiplier = float( is_land_at_distance_count) / float(n_directions);
         ant.pheromone_drop_multiplier *= float(is_land_nh_count) / float(n_directions);
@@ -222,13 +667,8 @@ namespace dtks{
 
                 probabilities *= land_nh; // zero out non-land directions right in front of us    
 
-                // random value based on probabilities (with C++ standard library)
-                std::discrete_distribution<int> direction_dist(
-                    probabilities.begin(),
-                    probabilities.end()
-                );
-
-                int choice = direction_dist(generator_);
+                // random value based on probabilities
+                int choice = sample_one_of_three(probabilities, generator);
                 if(choice == 0)
                 {
                     // go forward, do nothing
@@ -257,44 +697,90 @@ namespace dtks{
 
             // update age
             ant.age += 1;
-            
+        }
+        return is_land_nh_count != 0;
+    }
 
-            
-            if(ant.carrying_food)
+    template<class MAP>
+    void AntSimulation::ant_arrived(Ant & ant, MAP & pheromone_map)
+    {
+        if(ant.carrying_food)
+        {
+            // check for nest
+            if(nest_map_(ant.grid_position[0], ant.grid_position[1]) > 0)
             {
-                // check for nest
-                if(nest_map_(ant.grid_position[0], ant.grid_position[1]) > 0)
-                {
-                    ant.carrying_food = false;  
-                    ant.direction += M_PI; // turn around
-                    this->food_at_nest_ += 1;
-                }
-                else
-                {
-                    ant.time_since_home += 1;
-                }
+                ant.carrying_food = false;  
+                ant.direction += M_PI; // turn around
+                this->food_at_nest_ += 1;
             }
             else
             {
-                auto & food_amount = food_map_(ant.grid_position[0], ant.grid_position[1]);
-                // check for food
-                if(food_amount > 0)
-                {
-                    ant.carrying_food = true;  
-                    ant.direction += M_PI; // turn around
-                    this->food_collected_ += 1;
-                    food_amount -=  params_.infinite_food ? 0 : 1;
-                }
-                else
+                ant.time_since_home += 1;
+            }
+        }
+        else
+        {
+            auto & food_amount = food_map_(ant.grid_position[0], ant.grid_position[1]);
+            // check for food
+            if(food_amount > 0)
+            {
+                ant.carrying_food = true;  
+                ant.direction += M_PI; // turn around
+                this->food_collected_ += 1;
+                food_amount -=  params_.infinite_food ? 0 : 1;
+                if(food_amount == 0)
                 {
-                    ant.time_since_food += 1;
+                    food_depleted_ = true;
+                    if(is_packed_map<MAP> || !cell_flags_.empty())
+                    {
+                        cell_flags(pheromone_map, std::size_t(ant.grid_position[1]) * params_.shape[0] + ant.grid_position[0]) &= std::uint8_t(~cell_food);
+                    }
                 }
             }
+            else
+            {
+                ant.time_since_food += 1;
+            }
+        }
+    }
+
+    template<class MAP>
+    std::uint8_t & AntSimulation::cell_flags(MAP & pheromone_map, std::size_t i)
+    {
+        if constexpr(is_packed_map<MAP>)
+        {
+            return pheromone_map[i].flags;
         }
+        else
+        {
+            return cell_flags_[i];
+        }
+    }
 
+    template<class MAP>
+    std::uint8_t AntSimulation::cell_flags(const MAP & pheromone_map, std::size_t i) const
+    {
+        if constexpr(is_packed_map<MAP>)
+        {
+            return pheromone_map[i].flags;
+        }
+        else
+        {
+            return cell_flags_[i];
+        }
     }
 
-    std::array<int, 2> AntSimulation::round_and_wrap(const std::array<float, 2> & position)
+    template<class MAP>
+    void AntSimulation::deposit_pheromone(const Ant & ant, MAP & pheromone_map)
+    {
+        pheromone_map[ant.grid_position][int(ant.carrying_food)] += params_.pheromone_deposit_amount * ant.pheromone_drop_multiplier;
+        if(!pheromone_tiles_.empty())
+        {
+            pheromone_tiles_.activate(ant.grid_position[0], ant.grid_position[1]);
+        }
+    }
+
+    std::array<int, 2> AntSimulation::round_and_wrap(const std::array<float, 2> & position) const
     {
         std::array<int, 2> pos_rounded = {
             static_cast<int>(std::lround(position[0])),
@@ -307,58 +793,62 @@ namespace dtks{
 
     void AntSimulation::draw(uint8_t * display_image)
     {
+        throw_if_running();
 
 
         // auto min_max = channel_min_max(pheromone_map_);
         
         // display_image_ *= 0; // clear image
-        auto size = params_.shape[0] * params_.shape[1];
-        for(auto i=0; i<size; ++i)
-        {
-            auto pixel = display_image + i * 4;
-            pixel[0] = 0;
-            pixel[1] = 0;
-            pixel[2] = 0;
-            pixel[3] = 255;
-
-            // pheromone visualization
-            const auto max_val = 10.0f;
-
-            // normalized pheromone values
-            const auto & home_pheromone = pheromone_map_[i][0];
-            const auto & food_pheromone = pheromone_map_[i][1];
-            float truncated_home = home_pheromone > max_val ? max_val : home_pheromone;
-            float truncated_food = food_pheromone > max_val ? max_val : food_pheromone;
-
-            pixel[0] = static_cast<uint8_t>(truncated_food * 255.0/max_val);   
-            pixel[1] = static_cast<uint8_t>(truncated_home * 255.0/max_val); 
-            pixel[2] = 0;
-            pixel[3] = 255;  
-
-            if(nest_map_[i] > 0)
-            {
-                pixel[0] = 255;
-                pixel[1] = 255;
-                pixel[2] = 255;
-                pixel[3] = 255;  
-            }
-
-            if(food_map_[i] > 0)
+        std::visit([&](const auto & pheromone_map)
+        {
+            auto size = params_.shape[0] * params_.shape[1];
+            for(auto i=0; i<size; ++i)
             {
-                pixel[0] = 255;
+                auto pixel = display_image + i * 4;
+                pixel[0] = 0;
                 pixel[1] = 0;
                 pixel[2] = 0;
-                pixel[3] = 255;  
-            }
+                pixel[3] = 255;
 
-            if(is_land_[i] == 0)
-            {
-                pixel[0] = 50;
-                pixel[1] = 50;
-                pixel[2] = 50;
+                // pheromone visualization
+                const auto max_val = 10.0f;
+
+                // normalized pheromone values
+                const auto & home_pheromone = pheromone_map[i][0];
+                const auto & food_pheromone = pheromone_map[i][1];
+                float truncated_home = home_pheromone > max_val ? max_val : home_pheromone;
+                float truncated_food = food_pheromone > max_val ? max_val : food_pheromone;
+
+                pixel[0] = static_cast<uint8_t>(truncated_food * 255.0/max_val);   
+                pixel[1] = static_cast<uint8_t>(truncated_home * 255.0/max_val); 
+                pixel[2] = 0;
                 pixel[3] = 255;  
+
+                if(nest_map_[i] > 0)
+                {
+                    pixel[0] = 255;
+                    pixel[1] = 255;
+                    pixel[2] = 255;
+                    pixel[3] = 255;  
+                }
+
+                if(food_map_[i] > 0)
+                {
+                    pixel[0] = 255;
+                    pixel[1] = 0;
+                    pixel[2] = 0;
+                    pixel[3] = 255;  
+                }
+
+                if(is_land_[i] == 0)
+                {
+                    pixel[0] = 50;
+                    pixel[1] = 50;
+                    pixel[2] = 50;
+                    pixel[3] = 255;  
+                }
             }
-        }
+        }, pheromone_map_);
 
 
 
@@ -388,17 +878,43 @@ namespace dtks{
 
     void AntSimulation::ready()
     {
+        throw_if_running();
         // Prepare simulation (e.g., initialize ants)
         // each and needs to be placed at the nest location
 
+        // the nest and food pixels emit pheromone every step and water pixels are
+        // cleared, step() only visits these lists.
+        // The tiles of the sources in the pheromone map stay active
+        nest_positions_.clear();
+        food_pixels_.clear();
+        water_pixels_.clear();
+        food_depleted_ = false;
+        update_cell_flags();
+        if(!pheromone_tiles_.empty())
+        {
+            pheromone_tiles_.clear_persistent();
+        }
         for(int y = 0; y < params_.shape[1]; ++y)
         {
             for(int x = 0; x < params_.shape[0]; ++x)
             {
+                const auto i = std::uint32_t(y * params_.shape[0] + x);
                 if(nest_map_(x, y) > 0)
                 {
                     nest_positions_.push_back({x, y});
                 }
+                if(food_map_(x, y) > 0)
+                {
+                    food_pixels_.push_back(i);
+                }
+                if(is_land_(x, y) == 0)
+                {
+                    water_pixels_.push_back(i);
+                }
+                if(!pheromone_tiles_.empty() && (nest_map_(x, y) > 0 || food_map_(x, y) > 0))
+                {
+                    pheromone_tiles_.set_persistent(x, y);
+                }
             }   
         }
 
@@ -418,9 +934,58 @@ namespace dtks{
         }            
     }
 
-    Image2d<uint8_t> & AntSimulation::food_map()  { return food_map_; }
-    Image2d<uint8_t> & AntSimulation::nest_map()  { return nest_map_; }
-    Image2d<uint8_t> & AntSimulation::is_land()  { return is_land_; }
+    void AntSimulation::update_cell_flags()
+    {
+        const bool packed = params_.world_layout == WorldLayout::packed;
+        cell_flags_.assign(params_.parallel_ant_update || packed ? food_map_.size() : 0, 0);
+        for(int y = 0; y < params_.shape[1] && !cell_flags_.empty(); ++y)
+        {
+            for(int x = 0; x < params_.shape[0]; ++x)
+            {
+                cell_flags_[std::size_t(y) * params_.shape[0] + x] = (is_land_(x, y) ? cell_land : 0) | (nest_map_(x, y) > 0 ? cell_nest : 0) | (food_map_(x, y) > 0 ? cell_food : 0);
+            }
+        }
+        if(packed)
+        {
+            // move the flags into the records of the pheromone map
+            std::visit([&](auto & pheromone_map)
+            {
+                if constexpr(is_packed_map<std::decay_t<decltype(pheromone_map)>>)
+                {
+                    for(std::size_t i = 0; i < cell_flags_.size(); ++i)
+                    {
+                        pheromone_map[i].flags = cell_flags_[i];
+                    }
+                }
+            }, pheromone_map_);
+            std::vector<std::uint8_t>().swap(cell_flags_);
+        }
+    }
+
+    Image2d<uint8_t> & AntSimulation::food_map()  { throw_if_running(); return food_map_; }
+    Image2d<uint8_t> & AntSimulation::nest_map()  { throw_if_running(); return nest_map_; }
+    Image2d<uint8_t> & AntSimulation::is_land()  { throw_if_running(); return is_land_; }
+
+    PheromoneBuffer AntSimulation::pheromone_buffer()
+    {
+        throw_if_running();
+        return std::visit([&](auto & pheromone_map)
+        {
+            using pixel_type = typename std::decay_t<decltype(pheromone_map)>::value_type;
+            using scalar = typename scalar_type<pixel_type>::type;
+            static_assert(sizeof(pixel_type) % sizeof(scalar) == 0, "pixels must be whole numbers of channels");
+            return PheromoneBuffer{pheromone_map.data(), params_.pheromone_type, sizeof(pixel_type) / sizeof(scalar)};
+        }, pheromone_map_);
+    }
+
+    void AntSimulation::pheromone_map_modified()
+    {
+        throw_if_running();
+        if(!pheromone_tiles_.empty())
+        {
+            pheromone_tiles_.activate_all();
+        }
+    }
 
       
 
@@ -9,12 +9,39 @@
 #include <math.h>
 // pair
 #include <utility>
+#include <memory>
+#include <cstddef>
+#include <variant>
 #include "image.hpp"
+#include "half.hpp"
+#include "philox.hpp"
+#include "sampling.hpp"
+#include "thread_pool.hpp"
 
 namespace dtks{
 
     float to_radians(float degrees);
 
+    // scalar type of the pheromone map. The arithmetic happens in double for
+    // float64 and in float otherwise, float16 only stores IEEE half floats
+    enum class PheromoneType
+    {
+        float64,
+        float32,
+        float16
+    };
+
+    // separate: the pheromones, land, nest and food each live in their own map.
+    // packed: every pixel of the pheromone map also carries land / nest / food
+    // bits, so a sensor reads one record instead of up to four maps.
+    // food_map(), nest_map() and is_land() stay the maps to edit, ready() packs
+    // them, and the food counts remain in food_map()
+    enum class WorldLayout
+    {
+        separate,
+        packed
+    };
+
     struct Parameters
     {
         std::array<int, 2> shape = {1000, 1000};
@@ -25,6 +52,9 @@ namespace dtks{
         float beta_uniformity = 0.0001f;
         float beta_straight = 0.00f;
         float sigma_diffusion = 0.4f;
+        // the diffusion kernel reaches +- 3 sigma_diffusion. From this sigma on, which
+        // would take a wide kernel, it is approximated by box filters instead
+        float box_diffusion_sigma = 2.0f;
 
 
         float only_wall_turn_angle = to_radians(45.0f);
@@ -37,6 +67,19 @@ namespace dtks{
         float pheromone_truncation_threshold = 0.0001f;
         long seed = 42;
         bool infinite_food = true;
+
+        // move the ants in parallel, each with its own counter based random stream.
+        // The result only depends on the seed, not on n_threads, but differs from
+        // the serial update, where each ant already sees the deposits of the previous ones
+        bool parallel_ant_update = false;
+        // threads of the parallel ant update and of the diffusion in that mode, 0: all cores
+        std::size_t n_threads = 0;
+        // float32 / float16 halve / quarter the memory traffic of the pheromone map
+        PheromoneType pheromone_type = PheromoneType::float64;
+        // the pheromone map tracks which tiles of this size hold pheromone and only
+        // diffuses / evaporates around those, 0 processes the full map every step
+        int pheromone_tile_size = 64;
+        WorldLayout world_layout = WorldLayout::separate;
     };
 
 
@@ -60,22 +103,103 @@ namespace dtks{
 
 
 
+    // pixel of the packed world layout, indexing gives the pheromone channels
+    template<class T>
+    struct WorldCell
+    {
+        TinyVector<T, 2> pheromone;
+        // land / nest / food bits, see AntSimulation::CellFlags
+        std::uint8_t flags = 0;
+
+        inline T & operator[](std::size_t c) { return pheromone[c]; }
+        inline const T & operator[](std::size_t c) const { return pheromone[c]; }
+    };
+
+    // the flags do not count, tiles without pheromone are skipped by the diffusion
+    template<class T>
+    bool is_zero(const WorldCell<T> & value)
+    {
+        return is_zero(value.pheromone);
+    }
+
+    template<class T>
+    struct scalar_type<WorldCell<T>>
+    {
+        using type = T;
+    };
+
+    // what an ant perceives in its three sense directions (ahead, left, right)
+    struct AntSenses
+    {
+        TinyVector<float, 3> pheromones;
+        TinyVector<uint8_t, 3> land_nh;
+        std::size_t land_nh_count = 0;
+        std::size_t land_at_distance_count = 0;
+        // nest (with food) or food (without) seen in direction target_index
+        bool any_target = false;
+        int target_index = 0;
+    };
+
+    // raw pheromone map for zero copy views: channel c (0: home, 1: food) of pixel
+    // (x, y) is at data[(y * shape[0] + x) * pixel_stride + c], in elements of type.
+    // The packed layout stores the flags in between, so pixel_stride is 3 there
+    struct PheromoneBuffer
+    {
+        void * data = nullptr;
+        PheromoneType type = PheromoneType::float64;
+        std::size_t pixel_stride = 2;
+    };
+
+    // copy of the simulation state which other threads can read while the
+    // simulation keeps stepping, see AntSimulation::start()
+    struct AntSnapshot
+    {
+        std::size_t step = 0;
+        std::size_t food_collected = 0;
+        std::size_t food_at_nest = 0;
+        std::vector<Ant> ants;
+        // the bytes of the pheromone map, laid out as described by PheromoneBuffer
+        std::vector<std::byte> pheromones;
+        PheromoneType pheromone_type = PheromoneType::float64;
+        std::size_t pixel_stride = 2;
+    };
+
     class AntSimulation
     {
         public:
         friend struct Ant;
 
         AntSimulation(Parameters params);
+        // a running simulation must not be moved
+        AntSimulation(AntSimulation &&);
+        AntSimulation & operator=(AntSimulation &&);
+        ~AntSimulation();
 
 
         const Parameters& parameters() const;
 
         void step();
-        void nest_and_food_emit();
+        void run(std::size_t n_steps);
+
+        // async stepping: start() keeps stepping on a background thread until stop().
+        // Every snapshot_interval steps a copy of the state is published, which
+        // snapshot() returns without waiting for the simulation. Each snapshot is a new
+        // copy, which stays valid and unchanged for as long as a reader holds it.
+        // While running, step(), run(), ready(), draw() and the accessors of the live
+        // maps throw, and ants() must not be used. stop() rethrows an error of the
+        // background thread
+        void start(std::size_t snapshot_interval = 1);
+        void stop();
+        bool running() const;
+        void throw_if_running() const;
+        // the latest published snapshot while running, a fresh copy otherwise
+        std::shared_ptr<const AntSnapshot> snapshot() const;
+        // also while running, then the step the background thread has reached
+        std::size_t step_count() const;
         void update_ant_pos(Ant & ant);
 
         template<typename T>
-        inline void wrap(std::array<T, 2> & position)
+        inline void wrap(std::array<T, 2> & position) const
         {
             if(position[0] < 0) position[0] += params_.shape[0];
             if(position[0] >= params_.shape[0]) position[0] -= params_.shape[0];
@@ -83,10 +207,12 @@ namespace dtks{
             if(position[1] >= params_.shape[1]) position[1] -= params_.shape[1];
         }
 
-        std::array<int, 2> round_and_wrap(const std::array<float, 2> & position);
+        std::array<int, 2> round_and_wrap(const std::array<float, 2> & position) const;
 
         void draw(uint8_t * display_image);
 
+        // call after setting up the nest, food and land maps: places the ants and
+        // collects the pixels which emit / clear pheromone in every step
         void ready();
 
         Image2d<uint8_t> & food_map();
@@ -94,22 +220,88 @@ namespace dtks{
         Image2d<uint8_t> & is_land();
 
 
+        // the pheromone map and the ants live as long as the simulation, so views
+        // of them stay valid. Call pheromone_map_modified() after writing to the map
+        PheromoneBuffer pheromone_buffer();
+        // activates all tiles, so the next step() also diffuses pheromone written from outside
+        void pheromone_map_modified();
+        std::vector<Ant> & ants() { return ants_; }
+        const std::vector<Ant> & ants() const { return ants_; }
+
         inline std::size_t food_collected() const { return food_collected_; }
         inline std::size_t food_at_nest() const { return food_at_nest_; }
+        // tiles of the pheromone map which currently hold pheromone (empty if tiling is off)
+        const ActiveTiles & pheromone_tiles() const { return pheromone_tiles_; }
 
         private:
 
+            using PheromoneMap = std::variant<
+                MultiChannelImage2d<double, 2>,
+                MultiChannelImage2d<float, 2>,
+                MultiChannelImage2d<Half, 2>,
+                Image2d<WorldCell<double>>,
+                Image2d<WorldCell<float>>,
+                Image2d<WorldCell<Half>>
+            >;
+
+            // step() for the selected pheromone map type
+            template<class MAP>
+            void step_impl(MAP & pheromone_map);
+            template<class MAP>
+            void update_ants_parallel(MAP & pheromone_map);
+            void advance();
+            void copy_snapshot(AntSnapshot & snapshot) const;
+            void publish_snapshot();
+            // sense, turn and step forward. Only reads the maps, returns false if
+            // walls block all directions and the ant just turned on the spot
+            template<class RNG, class MAP>
+            bool move_ant(Ant & ant, RNG & generator, const MAP & pheromone_map);
+            template<class MAP>
+            void sense(const Ant & ant, const MAP & pheromone_map, AntSenses & senses) const;
+            // sense for n <= 64 consecutive ants at once, for the parallel update
+            template<class MAP>
+            void sense_block(const Ant * ants, std::size_t n, const MAP & pheromone_map, AntSenses * senses) const;
+            template<class RNG>
+            bool steer_and_step(Ant & ant, const AntSenses & senses, RNG & generator);
+            // pick up food / drop it at the nest at the ant's new position
+            template<class MAP>
+            void ant_arrived(Ant & ant, MAP & pheromone_map);
+            template<class MAP>
+            void deposit_pheromone(const Ant & ant, MAP & pheromone_map);
+            // set the pheromone of the nest and food pixels and clear it on water
+            template<class MAP>
+            void emit(MAP & pheromone_map);
         
             Parameters params_;
             std::vector<Ant> ants_;
 
-            MultiChannelImage2d<double, 2> pheromone_map_;  // 0: home, 1: food
-            MultiChannelImage2d<double, 2> temp_pheromone_map_;
+            PheromoneMap pheromone_map_;  // 0: home, 1: food
+            ActiveTiles pheromone_tiles_;
             Image2d<uint8_t> food_map_;
             Image2d<uint8_t> nest_map_;
             Image2d<uint8_t> is_land_;
 
             std::vector<std::array<int, 2>> nest_positions_;
+            std::vector<std::uint32_t> food_pixels_;
+            std::vector<std::uint32_t> water_pixels_;
+            // some food pixel ran empty, food_pixels_ needs to be compacted
+            bool food_depleted_ = false;
+            // land / nest / food bits of every pixel, so the parallel update
+            // gets all a sensor needs besides the pheromone with one load.
+            // With the packed layout they are stored in the pheromone map instead
+            enum CellFlags : std::uint8_t
+            {
+                cell_land = 1,
+                cell_nest = 2,
+                cell_food = 4
+            };
+            std::vector<std::uint8_t> cell_flags_;
+            // rebuild the flags from is_land_, nest_map_ and food_map_
+            void update_cell_flags();
+            template<class MAP>
+            std::uint8_t & cell_flags(MAP & pheromone_map, std::size_t i);
+            template<class MAP>
+            std::uint8_t cell_flags(const MAP & pheromone_map, std::size_t i) const;
 
             // how much food did we collect?
             std::size_t food_collected_ = 0;
@@ -120,6 +312,15 @@ namespace dtks{
             std::mt19937 generator_;
             std::uniform_real_distribution<float> direction_change_dist_;
 
+            // parallel ant update
+            std::size_t step_count_ = 0;
+            std::vector<std::uint8_t> moved_;
+            std::unique_ptr<ThreadPool> thread_pool_;
+
+            // background thread and snapshots of start() / stop()
+            struct AsyncStepping;
+            std::unique_ptr<AsyncStepping> async_;
+
 
     };
 
@@ -0,0 +1,277 @@
+#include "ants.hpp"
+#include "bench_args.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// headless benchmark for the ant simulation.
+// usage: ants_bench [n_ants] [n_steps]
+// times the three way direction choice with std::discrete_distribution
+// against sample_one_of_three, then reports ants / second of the full
+// simulation with the serial and the parallel ant update.
+//
+// usage: ants_bench --check
+// checks that sample_one_of_three picks each direction with the frequency
+// std::discrete_distribution would (and with libstdc++ the very same index),
+// and stresses start() / snapshot() / stop() with reader threads, which is
+// meant to be run under ThreadSanitizer as well. Returns 1 on mismatch.
+
+namespace
+{
+    using Weights = dtks::TinyVector<float, 3>;
+
+    // weights like the ones of the turning decision, with some blocked directions
+    std::vector<Weights> make_weights(std::size_t n, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> pheromone_dist(0.0f, 5.0f);
+        std::uniform_int_distribution<int> blocked_dist(0, 7);
+        std::vector<Weights> weights(n);
+        for(auto & w : weights)
+        {
+            for(std::size_t i = 0; i < 3; ++i)
+            {
+                w[i] = blocked_dist(generator) == 0 ? 0.0f : pheromone_dist(generator);
+            }
+        }
+        return weights;
+    }
+
+    template<class F>
+    double draws_per_second(const std::vector<Weights> & weights, std::size_t n_draws, F && draw)
+    {
+        std::mt19937 generator(42);
+        std::size_t checksum = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for(std::size_t i = 0; i < n_draws; ++i)
+        {
+            checksum += std::size_t(draw(weights[i % weights.size()], generator));
+        }
+        const auto stop = std::chrono::steady_clock::now();
+        // keep the draws from being optimized away
+        if(checksum == std::size_t(-1))
+        {
+            std::cout<<checksum<<"\n";
+        }
+        return double(n_draws) / std::chrono::duration<double>(stop - start).count();
+    }
+
+    int discrete_distribution_choice(const Weights & weights, std::mt19937 & generator)
+    {
+        std::discrete_distribution<int> dist(weights.begin(), weights.end());
+        return dist(generator);
+    }
+
+    // readers keep taking snapshots and checking their content while the
+    // simulation steps in the background, over several start / stop cycles
+    int check_async()
+    {
+        dtks::Parameters param;
+        param.shape = {120, 90};
+        param.n_ants = 300;
+        param.pheromone_tile_size = 16;
+        dtks::AntSimulation sim(param);
+        sim.nest_map()(60, 45) = 1;
+        sim.food_map()(20, 20) = 1;
+        sim.ready();
+
+        const std::size_t map_bytes = std::size_t(param.shape[0]) * param.shape[1] * 2 * sizeof(double);
+        std::atomic<int> n_bad{0};
+        for(std::size_t cycle = 0; cycle < 4; ++cycle)
+        {
+            sim.start(cycle % 2 + 1);
+            std::vector<std::thread> readers;
+            for(int r = 0; r < 3; ++r)
+            {
+                readers.emplace_back([&]
+                {
+                    std::size_t last_step = 0;
+                    for(int i = 0; i < 300; ++i)
+                    {
+                        // pause without a snapshot, like a reader doing other work,
+                        // so the simulation publishes while nobody holds the old one
+                        std::this_thread::sleep_for(std::chrono::microseconds(50 * (i % 8)));
+                        const auto snapshot = sim.snapshot();
+                        const std::size_t step = snapshot->step;
+                        bool ok = step >= last_step && snapshot->ants.size() == param.n_ants
+                            && snapshot->pheromones.size() == map_bytes;
+                        // a snapshot never changes while it is held, even across
+                        // several publishes
+                        double sum = 0.0;
+                        for(const auto & ant : snapshot->ants)
+                        {
+                            sum += ant.position[0];
+                        }
+                        std::this_thread::sleep_for(std::chrono::microseconds(50 * (i % 5)));
+                        double again = 0.0;
+                        for(const auto & ant : snapshot->ants)
+                        {
+                            again += ant.position[0];
+                        }
+                        ok = ok && sum == again && snapshot->step == step;
+                        n_bad += !ok;
+                        last_step = step;
+                    }
+                });
+            }
+            std::size_t last_count = sim.step_count();
+            for(int i = 0; i < 300; ++i)
+            {
+                const auto count = sim.step_count();
+                n_bad += count < last_count;
+                last_count = count;
+                std::this_thread::yield();
+            }
+            for(auto & reader : readers)
+            {
+                reader.join();
+            }
+            sim.stop();
+            n_bad += sim.snapshot()->step != sim.step_count();
+        }
+        const bool ok = n_bad == 0;
+        std::cout<<(ok ? "ok     " : "FAILED ")<<"start / snapshot / stop with concurrent readers\n";
+        return ok ? 0 : 1;
+    }
+
+    int check()
+    {
+        int n_failed = check_async();
+
+        // chi-square of the observed counts against the normalized weights,
+        // 2 degrees of freedom: 13.8 is the 0.999 quantile
+        const std::size_t n_draws = 1000000;
+        const Weights cases[] = {
+            {1.0f, 1.0f, 1.0f},
+            {5.0f, 0.5f, 0.5f},
+            {0.0f, 1.0f, 3.0f},
+            {2.0f, 0.0f, 0.0f},
+            {1e-4f, 2.5f, 1e-4f},
+            {0.3f, 0.0f, 0.7f}
+        };
+        for(const auto & w : cases)
+        {
+            std::mt19937 generator(1234);
+            std::size_t counts[3] = {0, 0, 0};
+            for(std::size_t i = 0; i < n_draws; ++i)
+            {
+                ++counts[dtks::sample_one_of_three(w, generator)];
+            }
+            const double sum = double(w[0]) + double(w[1]) + double(w[2]);
+            double chi_square = 0.0;
+            bool impossible_drawn = false;
+            for(std::size_t i = 0; i < 3; ++i)
+            {
+                const double expected = double(n_draws) * double(w[i]) / sum;
+                if(expected == 0.0)
+                {
+                    impossible_drawn |= counts[i] != 0;
+                    continue;
+                }
+                chi_square += (double(counts[i]) - expected) * (double(counts[i]) - expected) / expected;
+            }
+            const bool ok = chi_square < 13.8 && !impossible_drawn;
+            n_failed += !ok;
+            std::cout<<(ok ? "ok     " : "FAILED ")<<"weights "<<w[0]<<" "<<w[1]<<" "<<w[2]
+                <<"  counts "<<counts[0]<<" "<<counts[1]<<" "<<counts[2]<<"  chi^2 "<<chi_square<<"\n";
+        }
+
+        // all zero weights: std::discrete_distribution degenerates, the sampler goes straight
+        {
+            std::mt19937 generator(1234);
+            const bool ok = dtks::sample_one_of_three(Weights{0.0f, 0.0f, 0.0f}, generator) == 0;
+            n_failed += !ok;
+            std::cout<<(ok ? "ok     " : "FAILED ")<<"all zero weights pick 0\n";
+        }
+
+    #ifdef __GLIBCXX__
+        // same generator state, same thresholds: identical choices
+        {
+            const auto weights = make_weights(4096, 7);
+            std::mt19937 generator_a(99);
+            std::mt19937 generator_b(99);
+            std::size_t n_different = 0;
+            for(std::size_t i = 0; i < n_draws; ++i)
+            {
+                const auto & w = weights[i % weights.size()];
+                n_different += discrete_distribution_choice(w, generator_a) != dtks::sample_one_of_three(w, generator_b);
+            }
+            const bool ok = n_different == 0;
+            n_failed += !ok;
+            std::cout<<(ok ? "ok     " : "FAILED ")<<"identical to std::discrete_distribution in "
+                <<n_draws - n_different<<" / "<<n_draws<<" draws\n";
+        }
+    #endif
+
+        std::cout<<(n_failed == 0 ? "all ant checks passed" : "ant checks failed")<<"\n";
+        return n_failed == 0 ? 0 : 1;
+    }
+
+    double ants_per_second(std::size_t n_ants, std::size_t n_steps, bool parallel_ant_update)
+    {
+        dtks::Parameters param;
+        param.shape = {500, 500};
+        param.n_ants = n_ants;
+        param.parallel_ant_update = parallel_ant_update;
+        dtks::AntSimulation sim(param);
+        for(int y = 230; y < 270; ++y)
+        {
+            for(int x = 230; x < 270; ++x)
+            {
+                sim.nest_map()(x, y) = 1;
+            }
+        }
+        for(int y = 50; y < 80; ++y)
+        {
+            for(int x = 380; x < 420; ++x)
+            {
+                sim.food_map()(x, y) = 1;
+            }
+        }
+        sim.ready();
+
+        const auto start = std::chrono::steady_clock::now();
+        for(std::size_t i = 0; i < n_steps; ++i)
+        {
+            sim.step();
+        }
+        const auto stop = std::chrono::steady_clock::now();
+        return double(n_ants * n_steps) / std::chrono::duration<double>(stop - start).count();
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return check();
+    }
+
+    std::size_t n_ants = 10000;
+    std::size_t n_steps = 200;
+    if(!dtks::parse_counts(argc, argv, "ants_bench [n_ants] [n_steps] | --check", n_ants, n_steps))
+    {
+        return 2;
+    }
+
+    const auto weights = make_weights(4096, 7);
+    const std::size_t n_draws = 10000000;
+    const auto before = draws_per_second(weights, n_draws, discrete_distribution_choice);
+    const auto after = draws_per_second(weights, n_draws, [](const Weights & w, std::mt19937 & generator)
+    {
+        return dtks::sample_one_of_three(w, generator);
+    });
+    std::cout<<"direction choices / second  std::discrete_distribution "<<before
+        <<"  sample_one_of_three "<<after<<"  speedup "<<after / before<<"\n";
+
+    for(bool parallel_ant_update : {false, true})
+    {
+        std::cout<<(parallel_ant_update ? "parallel" : "serial  ")<<" ant update  "
+            <<n_ants<<" ants  ants / second "<<ants_per_second(n_ants, n_steps, parallel_ant_update)<<"\n";
+    }
+}
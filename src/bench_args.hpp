@@ -0,0 +1,56 @@
+#pragma once
+
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace dtks{
+
+    // the whole argument as a non negative number of type T,
+    // throws std::invalid_argument / std::out_of_range otherwise
+    template<class T>
+    T parse_count(const std::string & arg)
+    {
+        static_assert(std::is_integral_v<T>, "counts are integers");
+        std::size_t n_parsed = 0;
+        const auto value = std::stoll(arg, &n_parsed);
+        if(n_parsed != arg.size() || value < 0)
+        {
+            throw std::invalid_argument(arg);
+        }
+        if(static_cast<unsigned long long>(value) > static_cast<unsigned long long>(std::numeric_limits<T>::max()))
+        {
+            throw std::out_of_range(arg);
+        }
+        return static_cast<T>(value);
+    }
+
+    // the positional arguments argv[1], argv[2], ... into counts, the ones not
+    // given keep their defaults. Prints usage and returns false on a bad argument
+    template<class... T>
+    bool parse_counts(int argc, char ** argv, const char * usage, T & ... counts)
+    {
+        try
+        {
+            int i = 1;
+            auto next = [&](auto & count)
+            {
+                if(i < argc)
+                {
+                    count = parse_count<std::decay_t<decltype(count)>>(argv[i]);
+                }
+                ++i;
+            };
+            (next(counts), ...);
+        }
+        catch(const std::exception &)
+        {
+            std::cerr<<"usage: "<<usage<<"\n";
+            return false;
+        }
+        return true;
+    }
+
+} // namespace dtks
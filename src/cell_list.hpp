@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+namespace dtks{
+
+    // flat cell list for neighbor search on a periodic 2d domain.
+    // The domain is split into a uniform grid of cells which are at least
+    // cutoff / subdivision wide. The neighborhood of a cell is a precomputed
+    // stencil of all cells which can hold points closer than cutoff to some point
+    // of the cell. For subdivision 1 that is the 3x3 block, finer cells give a
+    // stencil which follows the interaction disc more closely, so fewer
+    // candidate pairs are tested and rejected.
+    // build() bins n points with a counting sort: afterwards the points of cell c
+    // are order()[cell_begin(c)] ... order()[cell_end(c) - 1], and cell_start_ is the
+    // prefix sum of the cell counts. All buffers are reused between builds, so
+    // rebuilding every step does not touch the allocator.
+    class CellList
+    {
+        public:
+
+        CellList() = default;
+
+        CellList(std::array<float, 2> domain_shape, float cutoff, int subdivision = 1)
+        {
+            if(subdivision < 1)
+            {
+                throw std::runtime_error("CellList: subdivision must be at least 1");
+            }
+            for(std::size_t d = 0; d < 2; ++d)
+            {
+                shape_[d] = std::max(1, static_cast<int>(domain_shape[d] * subdivision / cutoff));
+                cell_size_[d] = domain_shape[d] / float(shape_[d]);
+            }
+            cell_start_.assign(std::size_t(shape_[0]) * std::size_t(shape_[1]) + 1, 0);
+
+            // keep offsets whose closest distance to the center cell is below the cutoff.
+            // On grids with fewer than 2 * subdivision + 1 cells along an axis several
+            // offsets wrap onto the same cell, only the first of them is kept so no
+            // cell (and no pair) is visited twice
+            std::vector<bool> visited(n_cells(), false);
+            for(int dy = -subdivision; dy <= subdivision; ++dy)
+            {
+                for(int dx = -subdivision; dx <= subdivision; ++dx)
+                {
+                    const float gap_x = float(std::max(std::abs(dx) - 1, 0)) * cell_size_[0];
+                    const float gap_y = float(std::max(std::abs(dy) - 1, 0)) * cell_size_[1];
+                    const auto wrapped = neighbor_cell_index(0, {dx, dy});
+                    if(gap_x * gap_x + gap_y * gap_y < cutoff * cutoff && !visited[wrapped])
+                    {
+                        visited[wrapped] = true;
+                        stencil_.push_back({dx, dy});
+                    }
+                }
+            }
+        }
+
+        inline std::size_t n_cells() const
+        {
+            return cell_start_.size() - 1;
+        }
+
+        const std::array<int, 2>& shape() const
+        {
+            return shape_;
+        }
+
+        const std::array<float, 2>& cell_size() const
+        {
+            return cell_size_;
+        }
+
+        inline std::array<int, 2> cell(float x, float y) const
+        {
+            // clamp, x / cell_size may round up to shape for x just below the domain size
+            return {
+                std::min(static_cast<int>(x / cell_size_[0]), shape_[0] - 1),
+                std::min(static_cast<int>(y / cell_size_[1]), shape_[1] - 1)
+            };
+        }
+
+        inline std::size_t cell_index(float x, float y) const
+        {
+            const auto c = cell(x, y);
+            return std::size_t(c[1]) * shape_[0] + c[0];
+        }
+
+        inline std::size_t cell_begin(std::size_t cell_index) const
+        {
+            return cell_start_[cell_index];
+        }
+
+        inline std::size_t cell_end(std::size_t cell_index) const
+        {
+            return cell_start_[cell_index + 1];
+        }
+
+        const std::vector<std::array<int, 2>>& stencil() const
+        {
+            return stencil_;
+        }
+
+        // index of the cell at cell_index + offset, with periodic wrap
+        inline std::size_t neighbor_cell_index(std::size_t cell_index, const std::array<int, 2> & offset) const
+        {
+            const int cell_x = int(cell_index % shape_[0]);
+            const int cell_y = int(cell_index / shape_[0]);
+            return std::size_t(wrap_cell(cell_y + offset[1], shape_[1])) * shape_[0] + wrap_cell(cell_x + offset[0], shape_[0]);
+        }
+
+        // f(neighbor_cell_index) for all cells of the stencil around cell_index
+        template<class F>
+        inline void for_each_neighbor_cell(std::size_t cell_index, F && f) const
+        {
+            for(const auto & offset : stencil_)
+            {
+                f(neighbor_cell_index(cell_index, offset));
+            }
+        }
+
+        // number of (point, candidate neighbor) pairs a full neighborhood
+        // traversal visits, including each point itself
+        std::size_t candidate_pairs() const
+        {
+            std::size_t n = 0;
+            for(std::size_t c = 0; c < n_cells(); ++c)
+            {
+                std::size_t neighbors = 0;
+                for_each_neighbor_cell(c, [&](std::size_t neighbor_cell)
+                {
+                    neighbors += cell_end(neighbor_cell) - cell_begin(neighbor_cell);
+                });
+                n += (cell_end(c) - cell_begin(c)) * neighbors;
+            }
+            return n;
+        }
+
+        // sorted position -> original point index
+        const std::vector<std::uint32_t>& order() const
+        {
+            return order_;
+        }
+
+        void build(const float * x, const float * y, std::size_t n)
+        {
+            const auto n_cells = this->n_cells();
+            point_cell_.resize(n);
+            order_.resize(n);
+            std::fill(cell_start_.begin(), cell_start_.end(), 0u);
+
+            // histogram
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                const auto ci = cell_index(x[i], y[i]);
+                if(ci >= n_cells)
+                {
+                    throw std::runtime_error("Grid cell index out of bounds");
+                }
+                point_cell_[i] = static_cast<std::uint32_t>(ci);
+                ++cell_start_[ci + 1];
+            }
+
+            // exclusive prefix sum
+            for(std::size_t c = 0; c < n_cells; ++c)
+            {
+                cell_start_[c + 1] += cell_start_[c];
+            }
+
+            // scatter, cell_fill_ tracks the next free slot of each cell
+            cell_fill_.assign(cell_start_.begin(), cell_start_.end() - 1);
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                order_[cell_fill_[point_cell_[i]]++] = static_cast<std::uint32_t>(i);
+            }
+        }
+
+        private:
+
+        static inline int wrap_cell(int i, int n)
+        {
+            i %= n;
+            return i < 0 ? i + n : i;
+        }
+
+        std::array<int, 2> shape_ = {0, 0};
+        std::array<float, 2> cell_size_ = {1.0f, 1.0f};
+        std::vector<std::array<int, 2>> stencil_;
+        std::vector<std::uint32_t> cell_start_;
+        std::vector<std::uint32_t> cell_fill_;
+        std::vector<std::uint32_t> point_cell_;
+        std::vector<std::uint32_t> order_;
+    };
+
+} // namespace dtks
@@ -1,6 +1,8 @@
 #include <nanobind/nanobind.h>
 #include <nanobind/ndarray.h>
 #include <nanobind/stl/array.h>
+#include <nanobind/stl/function.h>
+#include <nanobind/stl/vector.h>
 
 #include "conf.hpp"
 
@@ -13,6 +15,8 @@ using namespace nb::literals;
 #endif
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <format>
 #include <random>
@@ -22,6 +26,8 @@ using namespace nb::literals;
 #include <utility>
 #include "image.hpp"
 #include "ants.hpp"
+#include "ant_ensemble.hpp"
+#include "particle_life.hpp"
 
 
 
@@ -34,6 +40,61 @@ using ImgUInt8 = nb::ndarray<uint8_t, nb::shape<-1, -1>, nb::device::cpu>;
 
 using RgbaImgUInt8 =  nb::ndarray<uint8_t, nb::shape<-1, -1, 4>, nb::device::cpu>;
 
+nb::dlpack::dtype pheromone_dtype(dtks::PheromoneType type)
+{
+    switch(type)
+    {
+        case dtks::PheromoneType::float64:
+            return nb::dtype<double>();
+        case dtks::PheromoneType::float32:
+            return nb::dtype<float>();
+        default:
+            return nb::dlpack::dtype{std::uint8_t(nb::dlpack::dtype_code::Float), 16, 1};
+    }
+}
+
+// (height, width, 2) view of pheromone map memory laid out as described by dtks::PheromoneBuffer
+nb::ndarray<nb::numpy> pheromone_view(void * data, dtks::PheromoneType type, std::size_t pixel_stride,
+    std::array<int, 2> shape, nb::handle owner = nb::handle())
+{
+    const std::size_t view_shape[3] = {std::size_t(shape[1]), std::size_t(shape[0]), 2};
+    const auto stride = std::int64_t(pixel_stride);
+    const std::int64_t strides[3] = {stride * shape[0], stride, 1};
+    return nb::ndarray<nb::numpy>(data, 3, view_shape, owner, strides, pheromone_dtype(type));
+}
+
+// zero copy strided view of one field of the ants, (n_ants,) or (n_ants, n_components)
+template<class T>
+nb::ndarray<nb::numpy, T> ant_field_view(const std::vector<dtks::Ant> & ants, std::size_t offset,
+    std::size_t n_components, nb::handle owner = nb::handle())
+{
+    static_assert(sizeof(dtks::Ant) % sizeof(T) == 0, "ants must be whole numbers of T");
+    auto data = reinterpret_cast<T *>(const_cast<std::uint8_t *>(reinterpret_cast<const std::uint8_t *>(ants.data())) + offset);
+    const std::size_t view_shape[2] = {ants.size(), n_components};
+    const std::int64_t strides[2] = {std::int64_t(sizeof(dtks::Ant) / sizeof(T)), 1};
+    return nb::ndarray<nb::numpy, T>(data, n_components == 1 ? 1 : 2, view_shape, owner, strides);
+}
+
+// the snapshot as a dict of arrays. They share the snapshot, which
+// is a private copy, so they stay valid while the simulation runs on
+nb::dict snapshot_dict(std::shared_ptr<const dtks::AntSnapshot> snapshot, std::array<int, 2> shape)
+{
+    using Pointer = std::shared_ptr<const dtks::AntSnapshot>;
+    nb::capsule owner(new Pointer(snapshot), [](void * p) noexcept { delete static_cast<Pointer *>(p); });
+    const auto & ants = snapshot->ants;
+    nb::dict result;
+    result["step"] = snapshot->step;
+    result["food_collected"] = snapshot->food_collected;
+    result["food_at_nest"] = snapshot->food_at_nest;
+    result["pheromone_map"] = pheromone_view(const_cast<std::byte *>(snapshot->pheromones.data()),
+        snapshot->pheromone_type, snapshot->pixel_stride, shape, owner);
+    result["ant_positions"] = ant_field_view<float>(ants, offsetof(dtks::Ant, position), 2, owner);
+    result["ant_directions"] = ant_field_view<float>(ants, offsetof(dtks::Ant, direction), 1, owner);
+    result["ant_carrying_food"] = ant_field_view<bool>(ants, offsetof(dtks::Ant, carrying_food), 1, owner);
+    result["ant_ages"] = ant_field_view<std::size_t>(ants, offsetof(dtks::Ant, age), 1, owner);
+    return result;
+}
+
 void export_ant_simulation(nb::module_& m)
 {
 
@@ -41,8 +102,28 @@ void export_ant_simulation(nb::module_& m)
     nb::class_<dtks::AntSimulation>(m, "AntSimulation")
         .def(nb::init<dtks::Parameters>())
         .def("step", &dtks::AntSimulation::step)
+        // the steps run without the GIL
+        .def("run", [](dtks::AntSimulation & self, std::size_t n_steps) {
+            nb::gil_scoped_release release;
+            self.run(n_steps);
+        }, nb::arg("n_steps"))
+        // background stepping, read the state with snapshot() meanwhile
+        .def("start", &dtks::AntSimulation::start, nb::arg("snapshot_interval") = 1)
+        .def("stop", [](dtks::AntSimulation & self) {
+            nb::gil_scoped_release release;
+            self.stop();
+        })
+        .def("running", &dtks::AntSimulation::running)
+        .def("step_count", &dtks::AntSimulation::step_count)
+        .def("snapshot", [](const dtks::AntSimulation & self) {
+            return snapshot_dict(self.snapshot(), self.parameters().shape);
+        })
         .def("ready", &dtks::AntSimulation::ready)
         .def("parameters", &dtks::AntSimulation::parameters,  nb::rv_policy::reference)
+        .def("n_active_pheromone_tiles", [](const dtks::AntSimulation & self) {
+            self.throw_if_running();
+            return self.pheromone_tiles().n_active();
+        })
 
 
         .def("food_map", [](dtks::AntSimulation & self) {
@@ -74,7 +155,33 @@ void export_ant_simulation(nb::module_& m)
             );
         }, nb::rv_policy::reference_internal)
 
+        // zero copy (height, width, 2) view of the pheromone map, channel 0: home, 1: food.
+        // The dtype follows Parameters.pheromone_type, call pheromone_map_modified()
+        // after writing to it
+        .def("pheromone_map", [](dtks::AntSimulation & self) {
+            const auto buffer = self.pheromone_buffer();
+            return pheromone_view(buffer.data, buffer.type, buffer.pixel_stride, self.parameters().shape);
+        }, nb::rv_policy::reference_internal)
+        .def("pheromone_map_modified", &dtks::AntSimulation::pheromone_map_modified)
 
+        // zero copy views of the ant state, one row per ant.
+        // The live views throw while the simulation runs, use snapshot() then
+        .def("ant_positions", [](dtks::AntSimulation & self) {
+            self.throw_if_running();
+            return ant_field_view<float>(self.ants(), offsetof(dtks::Ant, position), 2);
+        }, nb::rv_policy::reference_internal)
+        .def("ant_directions", [](dtks::AntSimulation & self) {
+            self.throw_if_running();
+            return ant_field_view<float>(self.ants(), offsetof(dtks::Ant, direction), 1);
+        }, nb::rv_policy::reference_internal)
+        .def("ant_carrying_food", [](dtks::AntSimulation & self) {
+            self.throw_if_running();
+            return ant_field_view<bool>(self.ants(), offsetof(dtks::Ant, carrying_food), 1);
+        }, nb::rv_policy::reference_internal)
+        .def("ant_ages", [](dtks::AntSimulation & self) {
+            self.throw_if_running();
+            return ant_field_view<std::size_t>(self.ants(), offsetof(dtks::Ant, age), 1);
+        }, nb::rv_policy::reference_internal)
 
 
         .def("draw",[](dtks::AntSimulation & self, RgbaImgUInt8 & img){
@@ -155,6 +262,17 @@ void export_ant_simulation(nb::module_& m)
         #endif
     ;
 
+    nb::enum_<dtks::PheromoneType>(m, "PheromoneType")
+        .value("float64", dtks::PheromoneType::float64)
+        .value("float32", dtks::PheromoneType::float32)
+        .value("float16", dtks::PheromoneType::float16)
+    ;
+
+    nb::enum_<dtks::WorldLayout>(m, "WorldLayout")
+        .value("separate", dtks::WorldLayout::separate)
+        .value("packed", dtks::WorldLayout::packed)
+    ;
+
     nb::class_<dtks::Parameters>(m, "Parameters")
         .def(nb::init<>())
         .def_rw("shape", &dtks::Parameters::shape)
@@ -168,10 +286,42 @@ void export_ant_simulation(nb::module_& m)
         .def_rw("wall_repellent_strength", &dtks::Parameters::wall_repellent_strength)
         .def_rw("beta_uniformity", &dtks::Parameters::beta_uniformity)
         .def_rw("sigma_diffusion", &dtks::Parameters::sigma_diffusion)
+        .def_rw("box_diffusion_sigma", &dtks::Parameters::box_diffusion_sigma)
         .def_rw("pheromone_truncation_threshold", &dtks::Parameters::pheromone_truncation_threshold)
         .def_rw("only_wall_turn_angle", &dtks::Parameters::only_wall_turn_angle)    \
         .def_rw("seed", &dtks::Parameters::seed)
         .def_rw("infinite_food", &dtks::Parameters::infinite_food)
+        .def_rw("parallel_ant_update", &dtks::Parameters::parallel_ant_update)
+        .def_rw("n_threads", &dtks::Parameters::n_threads)
+        .def_rw("pheromone_type", &dtks::Parameters::pheromone_type)
+        .def_rw("pheromone_tile_size", &dtks::Parameters::pheromone_tile_size)
+        .def_rw("world_layout", &dtks::Parameters::world_layout)
+    ;
+
+    nb::class_<dtks::AntEnsemble>(m, "AntEnsemble")
+        .def(nb::init<const std::vector<dtks::Parameters> &, std::size_t>(), nb::arg("parameters"), nb::arg("n_threads") = 0)
+        .def("__len__", &dtks::AntEnsemble::size)
+        .def("__getitem__", &dtks::AntEnsemble::simulation, nb::rv_policy::reference_internal)
+        .def("ready", [](dtks::AntEnsemble & self) {
+            nb::gil_scoped_release release;
+            self.ready();
+        })
+        .def("run", [](dtks::AntEnsemble & self, std::size_t n_steps) {
+            nb::gil_scoped_release release;
+            self.run(n_steps);
+        }, nb::arg("n_steps"))
+        // (n_simulations, 2) array of {food_collected, food_at_nest}
+        .def("metrics", [](const dtks::AntEnsemble & self) {
+            const auto metrics = self.metrics();
+            auto data = new std::uint64_t[metrics.size() * 2];
+            nb::capsule owner(data, [](void * p) noexcept { delete[] static_cast<std::uint64_t *>(p); });
+            for(std::size_t i = 0; i < metrics.size(); ++i)
+            {
+                data[2 * i] = metrics[i][0];
+                data[2 * i + 1] = metrics[i][1];
+            }
+            return nb::ndarray<nb::numpy, std::uint64_t, nb::shape<-1, 2>>(data, {metrics.size(), 2}, owner);
+        })
     ;
 };
 
@@ -181,7 +331,236 @@ void export_ant_simulation(nb::module_& m)
 
 
 
+using MatrixFloat = nb::ndarray<float, nb::shape<-1, -1>, nb::device::cpu>;
+
+// m[a, b] is the strength of the force on type a from type b
+dtks::Image2d<float> to_interaction_strength(const MatrixFloat & m)
+{
+    if(m.shape(0) != m.shape(1))
+    {
+        throw std::runtime_error("interaction_strength must be a square matrix");
+    }
+    const int n = int(m.shape(0));
+    dtks::Image2d<float> interaction_strength({n, n}, 0.0f);
+    for(int a = 0; a < n; ++a)
+    {
+        for(int b = 0; b < n; ++b)
+        {
+            interaction_strength(a, b) = m.data()[a * m.stride(0) + b * m.stride(1)];
+        }
+    }
+    return interaction_strength;
+}
+
+nb::ndarray<nb::numpy, float, nb::shape<-1, -1>> from_interaction_strength(const dtks::Image2d<float> & interaction_strength)
+{
+    const int n = interaction_strength.shape()[0];
+    float * data = new float[std::size_t(n) * std::size_t(n)];
+    nb::capsule owner(data, [](void * p) noexcept { delete[] static_cast<float *>(p); });
+    for(int a = 0; a < n; ++a)
+    {
+        for(int b = 0; b < n; ++b)
+        {
+            data[a * n + b] = interaction_strength(a, b);
+        }
+    }
+    return nb::ndarray<nb::numpy, float, nb::shape<-1, -1>>(data, {std::size_t(n), std::size_t(n)}, owner);
+}
+
+// zero copy view of one of the particle arrays
+template<class T>
+nb::ndarray<nb::numpy, T, nb::shape<-1>> particle_array_view(std::vector<T> & array)
+{
+    return nb::ndarray<nb::numpy, T, nb::shape<-1>>(array.data(), {array.size()}, nb::handle());
+}
+
+void export_particle_life(nb::module_& m)
+{
+    nb::enum_<dtks::SimdLevel>(m, "SimdLevel")
+        .value("none", dtks::SimdLevel::none)
+        .value("avx2", dtks::SimdLevel::avx2)
+        .value("avx512", dtks::SimdLevel::avx512)
+        .value("automatic", dtks::SimdLevel::automatic)
+    ;
+
+    nb::class_<dtks::ParticleLifeParameters>(m, "ParticleLifeParameters")
+        .def(nb::init<>())
+        .def_rw("n_particle_types", &dtks::ParticleLifeParameters::n_particle_types)
+        .def_rw("n_particles_per_type", &dtks::ParticleLifeParameters::n_particles_per_type)
+        .def_rw("shape", &dtks::ParticleLifeParameters::shape)
+        .def_rw("max_range", &dtks::ParticleLifeParameters::max_range)
+        .def_rw("seed", &dtks::ParticleLifeParameters::seed)
+        .def_rw("n_threads", &dtks::ParticleLifeParameters::n_threads)
+        .def_rw("simd_level", &dtks::ParticleLifeParameters::simd_level)
+        .def_rw("verlet_skin", &dtks::ParticleLifeParameters::verlet_skin)
+        .def_rw("cell_subdivision", &dtks::ParticleLifeParameters::cell_subdivision)
+        .def_rw("force_table_size", &dtks::ParticleLifeParameters::force_table_size)
+        .def_rw("force_curve", &dtks::ParticleLifeParameters::force_curve)
+        .def_prop_rw("interaction_strength",
+            [](const dtks::ParticleLifeParameters & self) {
+                return from_interaction_strength(self.interaction_strength);
+            },
+            [](dtks::ParticleLifeParameters & self, const MatrixFloat & m) {
+                self.interaction_strength = to_interaction_strength(m);
+            }
+        )
+    ;
+
+    // the particles are reordered by grid cell on every step, so index i of the
+    // array views refers to a different particle after step / run. ids() maps
+    // each slot to the particle's index at construction.
+    // The views themselves stay valid for the lifetime of the simulation.
+    nb::class_<dtks::ParticleSimulation>(m, "ParticleSimulation")
+        .def(nb::init<const dtks::ParticleLifeParameters &>())
+        .def("step", &dtks::ParticleSimulation::step)
+        .def("run", [](dtks::ParticleSimulation & self, std::size_t n_steps) {
+            nb::gil_scoped_release release;
+            for(std::size_t i = 0; i < n_steps; ++i)
+            {
+                self.step();
+            }
+        }, nb::arg("n_steps"))
+        // a copy: the cell list, force table and thread pool are built from the
+        // parameters at construction, set_interaction_strength is the only update
+        .def("parameters", [](const dtks::ParticleSimulation & self) {
+            return self.params_;
+        }, nb::rv_policy::copy)
+        .def("set_interaction_strength", [](dtks::ParticleSimulation & self, const MatrixFloat & m) {
+            self.set_interaction_strength(to_interaction_strength(m));
+        })
+        .def("__len__", [](const dtks::ParticleSimulation & self) {
+            return self.particles_.size();
+        })
+        .def_prop_ro("n_verlet_list_builds", [](const dtks::ParticleSimulation & self) {
+            return self.n_verlet_list_builds_;
+        })
+        .def_prop_ro("simd_level_used", &dtks::ParticleSimulation::simd_level_used)
+
+        .def("x", [](dtks::ParticleSimulation & self) {
+            return particle_array_view(self.particles_.x);
+        }, nb::rv_policy::reference_internal)
+        .def("y", [](dtks::ParticleSimulation & self) {
+            return particle_array_view(self.particles_.y);
+        }, nb::rv_policy::reference_internal)
+        .def("vx", [](dtks::ParticleSimulation & self) {
+            return particle_array_view(self.particles_.vx);
+        }, nb::rv_policy::reference_internal)
+        .def("vy", [](dtks::ParticleSimulation & self) {
+            return particle_array_view(self.particles_.vy);
+        }, nb::rv_policy::reference_internal)
+        .def("types", [](dtks::ParticleSimulation & self) {
+            return particle_array_view(self.particles_.type);
+        }, nb::rv_policy::reference_internal)
+        .def("ids", [](dtks::ParticleSimulation & self) {
+            return particle_array_view(self.particles_.id);
+        }, nb::rv_policy::reference_internal)
+    ;
+}
+
+using ImgFloat32 = nb::ndarray<float, nb::shape<-1, -1>, nb::device::cpu>;
+
+// zero copy view of a (height, width) array, any strides
+template<class T, class ARRAY>
+dtks::ImageView2d<T> image_view(ARRAY & array)
+{
+    return dtks::ImageView2d<T>(
+        array.data(),
+        {int(array.shape(1)), int(array.shape(0))},
+        {std::ptrdiff_t(array.stride(1)), std::ptrdiff_t(array.stride(0))}
+    );
+}
+
+template<class ARRAY>
+void check_same_shape(const ARRAY & src, const ARRAY & dst)
+{
+    if(src.shape(0) != dst.shape(0) || src.shape(1) != dst.shape(1))
+    {
+        throw std::runtime_error("src and dst must have the same shape");
+    }
+}
+
+// first and one past the last byte an array touches, for any strides
+template<class ARRAY>
+std::array<const std::uint8_t *, 2> byte_range(const ARRAY & array)
+{
+    using T = std::remove_pointer_t<decltype(array.data())>;
+    std::ptrdiff_t lo = 0;
+    std::ptrdiff_t hi = 0;
+    for(std::size_t d = 0; d < 2; ++d)
+    {
+        const auto extent = std::ptrdiff_t(array.stride(d)) * (std::ptrdiff_t(array.shape(d)) - 1);
+        (extent < 0 ? lo : hi) += extent;
+    }
+    const auto data = reinterpret_cast<const std::uint8_t *>(array.data());
+    return {data + lo * std::ptrdiff_t(sizeof(T)), data + (hi + 1) * std::ptrdiff_t(sizeof(T))};
+}
+
+// src as an image view. If src and dst overlap, src is copied to a scratch
+// image first, since the operations write rows of dst that other rows still read
+template<class T, class ARRAY>
+dtks::ImageView2d<const T> unaliased_source(ARRAY & src, const ARRAY & dst)
+{
+    const auto source = image_view<const T>(src);
+    const auto a = byte_range(src);
+    const auto b = byte_range(dst);
+    if(src.size() == 0 || a[0] >= b[1] || b[0] >= a[1])
+    {
+        return source;
+    }
+    // slots 0 and 1 are the temporaries of the operations themselves
+    auto copy = dtks::scratch_arena().image<T>(2, source.shape());
+    for(int y = 0; y < source.shape()[1]; ++y)
+    {
+        for(int x = 0; x < source.shape()[0]; ++x)
+        {
+            copy(x, y) = source(x, y);
+        }
+    }
+    return copy;
+}
+
+void export_image(nb::module_& m)
+{
+    m.def("enable_huge_pages", &dtks::enable_huge_pages, "enable"_a = true);
+    m.def("release_scratch_memory", []() {
+        dtks::scratch_arena().release();
+    });
+
+    // the image operations work in place on the numpy buffers,
+    // src and dst may be the same array
+    m.def("disc_erosion", [](ImgUInt8 src, ImgUInt8 dst, int radius) {
+        check_same_shape(src, dst);
+        dtks::discErosion(unaliased_source<uint8_t>(src, dst), image_view<uint8_t>(dst), radius, dtks::exec::par);
+    }, "src"_a, "dst"_a, "radius"_a, nb::call_guard<nb::gil_scoped_release>());
+    m.def("disc_dilation", [](ImgUInt8 src, ImgUInt8 dst, int radius) {
+        check_same_shape(src, dst);
+        dtks::discDilation(unaliased_source<uint8_t>(src, dst), image_view<uint8_t>(dst), radius, dtks::exec::par);
+    }, "src"_a, "dst"_a, "radius"_a, nb::call_guard<nb::gil_scoped_release>());
+    m.def("disc_opening", [](ImgUInt8 src, ImgUInt8 dst, int radius) {
+        check_same_shape(src, dst);
+        dtks::discOpening(unaliased_source<uint8_t>(src, dst), image_view<uint8_t>(dst), radius, dtks::exec::par);
+    }, "src"_a, "dst"_a, "radius"_a, nb::call_guard<nb::gil_scoped_release>());
+    m.def("disc_closing", [](ImgUInt8 src, ImgUInt8 dst, int radius) {
+        check_same_shape(src, dst);
+        dtks::discClosing(unaliased_source<uint8_t>(src, dst), image_view<uint8_t>(dst), radius, dtks::exec::par);
+    }, "src"_a, "dst"_a, "radius"_a, nb::call_guard<nb::gil_scoped_release>());
+
+    // periodic gaussian blur, src and dst may be the same array
+    m.def("gaussian_blur_wrap", [](ImgFloat32 src, ImgFloat32 dst, double sigma) {
+        check_same_shape(src, dst);
+        if(!(sigma > 0.0))
+        {
+            throw std::invalid_argument("sigma must be positive");
+        }
+        const auto radius = std::size_t(std::max(1L, std::lround(3.0 * sigma)));
+        dtks::gaussianSeparableWrap(image_view<const float>(src), image_view<float>(dst), radius, sigma, dtks::exec::par);
+    }, "src"_a, "dst"_a, "sigma"_a, nb::call_guard<nb::gil_scoped_release>());
+}
+
+
 NB_MODULE(dtks_ext, m) {
     m.doc() = "This is the kitchen sink";
     export_ant_simulation(m);
+    export_particle_life(m);
+    export_image(m);
 }
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "thread_pool.hpp"
+
+namespace dtks{
+
+    // where the whole image operations of image.hpp run:
+    //     gaussianSeparableWrap(src, dst, 3, 1.0, exec::par);
+    // exec::seq runs on the calling thread, exec::par on a process wide pool
+    // with all cores, and a ThreadPool * on that pool (nullptr: calling thread).
+    // Operations must not be nested inside chunks running on the same pool.
+    namespace exec
+    {
+        struct sequenced_policy
+        {
+        };
+
+        struct parallel_policy
+        {
+        };
+
+        inline constexpr sequenced_policy seq{};
+        inline constexpr parallel_policy par{};
+
+        // the pool behind exec::par, started on first use
+        inline ThreadPool & default_pool()
+        {
+            static ThreadPool pool;
+            return pool;
+        }
+    }
+
+    class Execution
+    {
+        public:
+
+        Execution(exec::sequenced_policy = exec::seq)
+        {
+        }
+
+        Execution(exec::parallel_policy)
+        :   pool_(&exec::default_pool())
+        {
+        }
+
+        Execution(ThreadPool * pool)
+        :   pool_(pool)
+        {
+        }
+
+        // nullptr for sequential execution
+        ThreadPool * pool() const
+        {
+            return pool_;
+        }
+
+        bool parallel() const
+        {
+            return pool_ != nullptr && pool_->size() > 1;
+        }
+
+        private:
+        ThreadPool * pool_ = nullptr;
+    };
+
+    // f(begin, end) on chunks of [0, n)
+    template<class F>
+    void parallel_chunks(Execution execution, std::size_t n, F && f)
+    {
+        if(execution.pool() != nullptr)
+        {
+            execution.pool()->parallel_for(0, n, f);
+        }
+        else
+        {
+            f(std::size_t(0), n);
+        }
+    }
+
+    // reduce(begin, end) -> R on chunks of [0, n), the chunk results are
+    // combined in order with combine(R, R) -> R, starting from init.
+    // The chunks only depend on n and the pool size
+    template<class R, class REDUCE, class COMBINE>
+    R parallel_reduce(Execution execution, std::size_t n, R init, REDUCE && reduce, COMBINE && combine)
+    {
+        if(!execution.parallel() || n == 0)
+        {
+            return combine(init, reduce(std::size_t(0), n));
+        }
+        const auto n_chunks = execution.pool()->size() * 4;
+        const auto grain = (n + n_chunks - 1) / n_chunks;
+        std::vector<R> partial((n + grain - 1) / grain, init);
+        execution.pool()->parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end)
+        {
+            partial[begin / grain] = reduce(begin, end);
+        });
+        R result = init;
+        for(const auto & value : partial)
+        {
+            result = combine(result, value);
+        }
+        return result;
+    }
+
+} // namespace dtks
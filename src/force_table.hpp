@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "image.hpp"
+
+namespace dtks{
+
+    // tabulated particle-life pair forces.
+    // For each (type_a, type_b) the table samples
+    //     h(d^2) = curve(dist / range, strength(type_a, type_b)) * range / dist
+    // on n_samples + 1 points uniformly spaced in the squared distance d^2 in [0, range^2]
+    // (plus a copy of the last one, so lookups of d^2 rounding up to range^2 stay in bounds),
+    // so the force on a from b is h(d^2) * (pos_b - pos_a) with one linear
+    // interpolation and no sqrt or division.
+    // h diverges like 1 / dist at zero, the first sample is therefore copied from the
+    // second one, which softens the core below dist = range / sqrt(n_samples).
+    class ForceTable
+    {
+        public:
+
+        ForceTable() = default;
+
+        // curve(r, a) with r the distance in units of range and a the interaction strength
+        template<class CURVE>
+        ForceTable(const Image2d<float> & interaction_strength, float range, std::size_t n_samples, CURVE && curve)
+        :   n_types_(std::size_t(interaction_strength.shape()[0])),
+            n_samples_(n_samples),
+            scale_(float(n_samples) / (range * range)),
+            values_(n_types_ * n_types_ * (n_samples + 2))
+        {
+            const float bin = range * range / float(n_samples);
+            for(std::size_t a = 0; a < n_types_; ++a)
+            {
+                for(std::size_t b = 0; b < n_types_; ++b)
+                {
+                    float * row = values_.data() + (a * n_types_ + b) * stride();
+                    const float strength = interaction_strength(int(a), int(b));
+                    for(std::size_t k = 1; k <= n_samples; ++k)
+                    {
+                        const float dist = std::sqrt(float(k) * bin) + 1e-6f;
+                        row[k] = curve(dist / range, strength) * range / dist;
+                    }
+                    row[0] = row[1];
+                    row[n_samples + 1] = row[n_samples];
+                }
+            }
+        }
+
+        bool empty() const
+        {
+            return values_.empty();
+        }
+
+        // samples for all neighbor types of a particle of type a:
+        // the samples of pair (a, b) start at row(a) + b * stride()
+        inline const float * row(std::size_t a) const
+        {
+            return values_.data() + a * n_types_ * stride();
+        }
+
+        inline std::size_t stride() const
+        {
+            return n_samples_ + 2;
+        }
+
+        inline std::size_t n_samples() const
+        {
+            return n_samples_;
+        }
+
+        // squared distance -> fractional sample index
+        inline float scale() const
+        {
+            return scale_;
+        }
+
+        // h(dist_sq) for pair (a, b), dist_sq must be below range^2
+        inline float operator()(std::size_t a, std::size_t b, float dist_sq) const
+        {
+            return lookup(row(a) + b * stride(), dist_sq * scale_);
+        }
+
+        static inline float lookup(const float * samples, float t)
+        {
+            const auto k = static_cast<std::size_t>(t);
+            const float frac = t - float(k);
+            return samples[k] + frac * (samples[k + 1] - samples[k]);
+        }
+
+        private:
+        std::size_t n_types_ = 0;
+        std::size_t n_samples_ = 0;
+        float scale_ = 0.0f;
+        std::vector<float> values_;
+    };
+
+} // namespace dtks
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+namespace dtks{
+
+    // IEEE 754 binary16 storage type. Arithmetic happens in float: a Half converts
+    // implicitly to float and explicitly back (round to nearest even).
+    // Magnitudes beyond the largest finite half (65504) saturate instead of becoming inf.
+    // The conversions follow F. Giesen's branch light float <-> half routines, which
+    // (unlike scalar F16C calls) let the compiler vectorize loops over Half arrays.
+    class Half
+    {
+        public:
+
+        Half() = default;
+
+        explicit Half(float value)
+        :   bits_(from_float(value))
+        {
+        }
+
+        operator float() const
+        {
+            return to_float(bits_);
+        }
+
+        Half & operator+=(float value)
+        {
+            bits_ = from_float(float(*this) + value);
+            return *this;
+        }
+
+        Half & operator*=(float value)
+        {
+            bits_ = from_float(float(*this) * value);
+            return *this;
+        }
+
+        std::uint16_t bits() const
+        {
+            return bits_;
+        }
+
+        static std::uint16_t from_float(float value)
+        {
+            const std::uint32_t sign = std::bit_cast<std::uint32_t>(value) & 0x80000000u;
+            std::uint32_t x = std::bit_cast<std::uint32_t>(value) ^ sign;
+            std::uint16_t result;
+            if(x > (255u << 23))
+            {
+                // nan
+                result = 0x7e00;
+            }
+            else if(x >= std::bit_cast<std::uint32_t>(65504.0f))
+            {
+                result = 0x7bff;
+            }
+            else if(x < (113u << 23))
+            {
+                // zero / subnormal: let the float adder do the rounding
+                const float magic = std::bit_cast<float>(std::uint32_t(((127 - 15) + (23 - 10) + 1) << 23));
+                result = std::uint16_t(std::bit_cast<std::uint32_t>(std::bit_cast<float>(x) + magic) - std::bit_cast<std::uint32_t>(magic));
+            }
+            else
+            {
+                // normal: rebias the exponent and round the mantissa to nearest even
+                const std::uint32_t mantissa_odd = (x >> 13) & 1u;
+                x += (std::uint32_t(15 - 127) << 23) + 0xfffu + mantissa_odd;
+                result = std::uint16_t(x >> 13);
+            }
+            return result | std::uint16_t(sign >> 16);
+        }
+
+        static float to_float(std::uint16_t bits)
+        {
+            constexpr std::uint32_t exponent_mask = 0x7c00u << 13;
+            std::uint32_t x = std::uint32_t(bits & 0x7fffu) << 13;
+            const std::uint32_t exponent = x & exponent_mask;
+            x += std::uint32_t(127 - 15) << 23;
+            if(exponent == exponent_mask)
+            {
+                // inf / nan
+                x += std::uint32_t(128 - 16) << 23;
+            }
+            else if(exponent == 0)
+            {
+                // zero / subnormal: renormalize with a float subtraction
+                x += 1u << 23;
+                x = std::bit_cast<std::uint32_t>(std::bit_cast<float>(x) - std::bit_cast<float>(113u << 23));
+            }
+            return std::bit_cast<float>(x | (std::uint32_t(bits & 0x8000u) << 16));
+        }
+
+        private:
+        std::uint16_t bits_ = 0;
+    };
+
+} // namespace dtks
@@ -1,11 +1,19 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <limits>
+#include <stdexcept>
 #include <type_traits>
 #include <iostream>
 #include "tiny_vector.hpp"
+#include "active_tiles.hpp"
+#include "aligned_allocator.hpp"
+#include "execution.hpp"
+#include "image_view.hpp"
+#include "scratch_arena.hpp"
 
 // Wrap index into [0, n)
 inline int wrap(int i, int n)
@@ -22,10 +30,12 @@ namespace dtks{
     
 
 
+    // owning 2d image, the pixels are stored row major in 64 byte aligned memory
+    // (huge pages for large images after enable_huge_pages())
     template<class T>
     class Image2d{
         public:
-
+        using value_type = T;
 
         Image2d() = default;
         
@@ -95,32 +105,60 @@ namespace dtks{
             return data_.data();
         }
 
+        auto data() const
+        {
+            return data_.data();
+        }
+
+        ImageView2d<T> view()
+        {
+            return ImageView2d<T>(data_.data(), shape_);
+        }
+
+        ImageView2d<const T> view() const
+        {
+            return ImageView2d<const T>(data_.data(), shape_);
+        }
+
 
         private:
         std::array<int, 2> shape_;
-        std::vector<T> data_;
+        std::vector<T, AlignedAllocator<T>> data_;
     };
 
 
-    // element wise operators (we focus on those we need)
-    #define DEFINE_ELEMENTWISE_OP(OP) \
+    // element wise operators (we focus on those we need).
+    // The named versions take an execution policy: multiply(image, 0.5f, exec::par)
+    #define DEFINE_ELEMENTWISE_OP(OP, NAME) \
     template<class T, class U> \
-    Image2d<T>& operator OP( \
+    Image2d<T>& NAME( \
         Image2d<T>& img, \
-        const U & element \
+        const U & element, \
+        Execution execution = exec::seq \
     ) \
     { \
-        for(std::size_t i = 0; i < img.size(); ++i) \
+        parallel_chunks(execution, img.size(), [&](std::size_t begin, std::size_t end) \
         { \
-            img[i] OP element; \
-        } \
+            for(std::size_t i = begin; i < end; ++i) \
+            { \
+                img[i] OP element; \
+            } \
+        }); \
         return img; \
+    } \
+    template<class T, class U> \
+    Image2d<T>& operator OP( \
+        Image2d<T>& img, \
+        const U & element \
+    ) \
+    { \
+        return NAME(img, element); \
     }
 
-    DEFINE_ELEMENTWISE_OP(+=)
-    DEFINE_ELEMENTWISE_OP(-=)
-    DEFINE_ELEMENTWISE_OP(*=)
-    DEFINE_ELEMENTWISE_OP(/=)
+    DEFINE_ELEMENTWISE_OP(+=, add)
+    DEFINE_ELEMENTWISE_OP(-=, subtract)
+    DEFINE_ELEMENTWISE_OP(*=, multiply)
+    DEFINE_ELEMENTWISE_OP(/=, divide)
 
     #undef DEFINE_ELEMENTWISE_OP
 
@@ -149,28 +187,42 @@ namespace dtks{
     std::pair<
         std::array<T, N>,
         std::array<T, N>
-    > channel_min_max(const MultiChannelImage2d<T, N> & image)
+    > channel_min_max(const MultiChannelImage2d<T, N> & image, Execution execution = exec::seq)
     {
-        std::array<T, N> min_vals;
-        std::array<T, N> max_vals;
-
+        using MinMax = std::pair<std::array<T, N>, std::array<T, N>>;
+        MinMax init;
         for(std::size_t c = 0; c < N; ++c)
         {
-            min_vals[c] = std::numeric_limits<T>::max();
-            max_vals[c] = std::numeric_limits<T>::lowest();
+            init.first[c] = std::numeric_limits<T>::max();
+            init.second[c] = std::numeric_limits<T>::lowest();
         }
 
-        for(std::size_t i = 0; i < image.size(); ++i)
-        {
-            const auto & pixel = image[i];
-            for(std::size_t c = 0; c < N; ++c)
+        return parallel_reduce(execution, image.size(), init,
+            [&](std::size_t begin, std::size_t end)
             {
-                if(pixel[c] < min_vals[c]) min_vals[c] = pixel[c];
-                if(pixel[c] > max_vals[c]) max_vals[c] = pixel[c];
+                auto [min_vals, max_vals] = init;
+                for(std::size_t i = begin; i < end; ++i)
+                {
+                    const auto & pixel = image[i];
+                    for(std::size_t c = 0; c < N; ++c)
+                    {
+                        if(pixel[c] < min_vals[c]) min_vals[c] = pixel[c];
+                        if(pixel[c] > max_vals[c]) max_vals[c] = pixel[c];
+                    }
+                }
+                return MinMax{min_vals, max_vals};
+            },
+            [](const MinMax & a, const MinMax & b)
+            {
+                MinMax result = a;
+                for(std::size_t c = 0; c < N; ++c)
+                {
+                    if(b.first[c] < result.first[c]) result.first[c] = b.first[c];
+                    if(b.second[c] > result.second[c]) result.second[c] = b.second[c];
+                }
+                return result;
             }
-        }
-
-        return {min_vals, max_vals};
+        );
     }
 
 
@@ -198,6 +250,38 @@ namespace dtks{
     };
 
 
+    template<class T>
+    bool is_zero(const T & value)
+    {
+        return value == T(0);
+    }
+
+    template<class T, std::size_t N>
+    bool is_zero(const TinyVector<T, N> & value)
+    {
+        for(std::size_t i = 0; i < N; ++i)
+        {
+            if(!is_zero(value[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // element type of a scalar or multichannel pixel
+    template<class T>
+    struct scalar_type
+    {
+        using type = T;
+    };
+
+    template<class T, std::size_t N>
+    struct scalar_type<TinyVector<T, N>>
+    {
+        using type = T;
+    };
+
     
     template<class T, class SCALAR>
     void add_weighted(T & target, const T & value, SCALAR weight)
@@ -212,6 +296,153 @@ namespace dtks{
             target[i] += value[i] * weight;
         }
     }
+    template<class T, class SCALAR, std::size_t N>
+    void add_weighted(TinyVector<T, N> & target, const TinyVector<T, N> & value, SCALAR weight)
+    {
+        for(std::size_t i = 0; i < N; ++i)
+        {
+            target[i] += value[i] * weight;
+        }
+    }
+
+    // normalized 1d gaussian with 2 * r + 1 taps, any radius
+    template<class K>
+    std::vector<K> gaussian_kernel(int r, double sigma)
+    {
+        std::vector<K> kernel(2 * r + 1, K(1));
+        if(r > 0)
+        {
+            K sum = K(0);
+            for (int i = -r; i <= r; ++i)
+            {
+                K v = std::exp(-(i * i) / (K(2) * sigma * sigma));
+                kernel[i + r] = v;
+                sum += v;
+            }
+            for (auto & v : kernel)
+            {
+                v /= sum;
+            }
+        }
+        return kernel;
+    }
+
+    // the blur weights: float for float pixels, double otherwise
+    template<class T>
+    using gaussian_kernel_type = std::conditional_t<std::is_same_v<typename scalar_type<T>::type, float>, float, double>;
+
+    // out[x] = sum_i kernel[i + r] * in[wrap(x + i)] for x in [begin, end),
+    // only the pixels within r of the row ends need to wrap
+    template<class T, class K>
+    void convolve_row_wrap(const T * in, T * out, int width, int begin, int end, const K * kernel, int r)
+    {
+        auto convolve = [&](int x, auto && index)
+        {
+            T acc = zero<T>::value();
+            for (int i = -r; i <= r; ++i)
+            {
+                add_weighted(acc, in[index(x + i)], kernel[i + r]);
+            }
+            out[x] = acc;
+        };
+        const int interior_begin = std::min(std::max(begin, r), end);
+        const int interior_end = std::max(interior_begin, std::min(end, width - r));
+        for (int x = begin; x < interior_begin; ++x)
+        {
+            convolve(x, [&](int i){ return wrap(i, width); });
+        }
+        for (int x = interior_begin; x < interior_end; ++x)
+        {
+            convolve(x, [](int i){ return i; });
+        }
+        for (int x = interior_end; x < end; ++x)
+        {
+            convolve(x, [&](int i){ return wrap(i, width); });
+        }
+    }
+
+    // periodic gaussian blur. tmp receives the horizontal pass and needs contiguous
+    // rows, src and dst may be strided and may be the same image. The rows of both
+    // passes are split across the execution policy, the vertical pass runs over
+    // whole rows so it vectorizes along x
+    template<typename S, class U>
+    void gaussianSeparableWrap(
+        ImageView2d<S> src,
+        ImageView2d<std::remove_const_t<S>> tmp,
+        ImageView2d<U> dst,
+        std::size_t kernelR,
+        double sigma,
+        Execution execution = exec::seq
+    )
+    {
+        using T = std::remove_const_t<S>;
+        const int r = static_cast<int>(kernelR);
+            
+        const auto width = src.shape()[0];
+        const auto height = src.shape()[1];
+        if(!tmp.contiguous_rows())
+        {
+            throw std::runtime_error("gaussianSeparableWrap: tmp needs contiguous rows");
+        }
+
+        using K = gaussian_kernel_type<T>;
+        const auto kernel = gaussian_kernel<K>(r, sigma);
+
+        // --- horizontal pass ---
+        parallel_chunks(execution, std::size_t(height), [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<T> buffer;
+            for (auto y = int(begin); y < int(end); ++y)
+            {
+                convolve_row_wrap(load_row(src, y, buffer), tmp.row(y), width, 0, width, kernel.data(), r);
+            }
+        });
+
+        // --- vertical pass ---
+        // tap by tap over blocks of a row, the accumulators stay in cache
+        constexpr int block = 256;
+        parallel_chunks(execution, std::size_t(height), [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<const T *> rows(2 * r + 1);
+            std::vector<T> acc(block);
+            for (auto y = int(begin); y < int(end); ++y)
+            {
+                for (int i = -r; i <= r; ++i)
+                {
+                    rows[i + r] = tmp.row(wrap(y + i, height));
+                }
+                for (int block_begin = 0; block_begin < width; block_begin += block)
+                {
+                    const int n = std::min(block, width - block_begin);
+                    std::fill(acc.begin(), acc.begin() + n, zero<T>::value());
+                    for (int i = 0; i <= 2 * r; ++i)
+                    {
+                        const T * row = rows[i] + block_begin;
+                        const K weight = kernel[i];
+                        for (int x = 0; x < n; ++x)
+                        {
+                            add_weighted(acc[x], row[x], weight);
+                        }
+                    }
+                    store_row(dst, y, block_begin, acc.data(), n);
+                }
+            }
+        });
+    }
+
+    // tmp from scratch_arena()
+    template<typename S, class U>
+    void gaussianSeparableWrap(
+        ImageView2d<S> src,
+        ImageView2d<U> dst,
+        std::size_t kernelR,
+        double sigma,
+        Execution execution = exec::seq
+    )
+    {
+        auto tmp = scratch_arena().image<std::remove_const_t<S>>(0, src.shape());
+        gaussianSeparableWrap(src, tmp, dst, kernelR, sigma, execution);
+    }
 
     template<typename T,class U>
     void gaussianSeparableWrap(
@@ -219,91 +450,508 @@ namespace dtks{
         Image2d<T>& tmp,
         Image2d<U>& dst_image,
         std::size_t kernelR,
-        double sigma
+        double sigma,
+        Execution execution = exec::seq
+    )
+    {
+        gaussianSeparableWrap(src_image.view(), tmp.view(), dst_image.view(), kernelR, sigma, execution);
+    }
+
+    template<typename T>
+    void gaussianSeparableWrap(
+        const Image2d<T>& src_image,
+        Image2d<T>& dst_image,
+        std::size_t kernelR,
+        double sigma,
+        Execution execution = exec::seq
+    )
+    {
+        gaussianSeparableWrap(src_image.view(), dst_image.view(), kernelR, sigma, execution);
+    }
+
+    // in place gaussianSeparableWrap fused with per pixel operations before and after the blur:
+    //     image = post(gauss(pre(image)), image)
+    // with pre(x, y, value) -> value and post(value, old_pixel) -> pixel, old_pixel
+    // lets post keep parts of a pixel which are not blurred.
+    // The blur runs on the pixel type pre returns, so pre / post can also convert a
+    // compact storage type to a wider one for the arithmetic and back.
+    // Instead of a full size temporary image, the horizontal pass is kept for the
+    // 2 * kernelR + 1 rows the vertical pass needs, so the image is read and
+    // written only once. kernelR == 0 only applies pre and post.
+    //
+    // With tiles, only the active tiles and the tiles within kernelR of them are
+    // visited, the others are assumed to be zero and to stay zero, i.e. pre and post
+    // must map zero to zero outside the persistent tiles. Afterwards the active set
+    // is updated to the tiles holding non zero values.
+    //
+    // In parallel, strips of tile rows are blurred at once. The horizontal pass
+    // of the rows within kernelR of a strip boundary (their halo) is computed up front,
+    // since the neighboring strip may overwrite them. The result does not depend on
+    // the number of threads.
+    template<typename T, class PRE, class POST>
+    void gaussianSeparableWrapFused(
+        Image2d<T>& image,
+        std::size_t kernelR,
+        double sigma,
+        PRE && pre,
+        POST && post,
+        ActiveTiles * tiles = nullptr,
+        Execution execution = exec::seq
     )
     {
         const int r = static_cast<int>(kernelR);
         const int ksize = 2 * r + 1;
-            
-        const auto width = src_image.shape()[0];
-        const auto height = src_image.shape()[1];
 
-        using K = double;
+        const auto width = image.shape()[0];
+        const auto height = image.shape()[1];
 
-        // --- build 1D Gaussian kernel on stack ---
-        K kernel[64]; // assume ksize <= 64 (adjust if needed)
-        K sum = K(0);
+        using V = std::decay_t<decltype(pre(0, 0, image(0, 0)))>;
+        using K = gaussian_kernel_type<V>;
+        const auto kernel = gaussian_kernel<K>(r, sigma);
 
-        for (int i = -r; i <= r; ++i)
+        // without tiles all tiles are active
+        ActiveTiles all;
+        if(tiles == nullptr)
         {
-            K v = std::exp(-(i * i) / (K(2) * sigma * sigma));
-            kernel[i + r] = v;
-            sum += v;
+            all = ActiveTiles(image.shape(), 64);
+            all.activate_all();
+            tiles = &all;
         }
+        const int tile_size = tiles->tile_size();
+        const int n_tiles_x = tiles->n_tiles()[0];
+        // a partial last tile makes the way around the wrap one tile shorter
+        // in pixels than in tiles
+        const bool partial_tiles = width % tile_size != 0 || height % tile_size != 0;
+        const auto visit = tiles->dilated(r == 0 ? 0 : (r + tile_size - 1) / tile_size + (partial_tiles ? 1 : 0));
+        std::vector<std::uint8_t> non_zero(tiles->size(), 0);
+
+        // the tile columns of row y which are visited
+        auto row_mask = [&](int y)
+        {
+            return visit.data() + std::size_t(y / tile_size) * n_tiles_x;
+        };
+        auto for_each_span = [&](const std::uint8_t * mask, auto && f)
+        {
+            for (int tx = 0; tx < n_tiles_x; ++tx)
+            {
+                if(!mask[tx])
+                {
+                    continue;
+                }
+                const int begin = tx;
+                while(tx + 1 < n_tiles_x && mask[tx + 1])
+                {
+                    ++tx;
+                }
+                f(begin * tile_size, std::min((tx + 1) * tile_size, width));
+            }
+        };
 
-        // normalize
-        for (int i = 0; i < ksize; ++i)
+        // per thread buffers of the horizontal pass
+        struct RowScratch
+        {
+            std::vector<std::uint8_t> h_mask;
+            std::vector<V> source_row;
+        };
+        auto make_row_scratch = [&]()
         {
-            kernel[i] /= sum;
+            return RowScratch{std::vector<std::uint8_t>(n_tiles_x), std::vector<V>(width)};
+        };
+        // h_mask: the tile columns of the horizontal pass of row y,
+        // which all output rows within r of y need
+        auto horizontal_row = [&](int y, V * out, RowScratch & scratch)
+        {
+            auto & h_mask = scratch.h_mask;
+            auto & source_row = scratch.source_row;
+            std::fill(h_mask.begin(), h_mask.end(), std::uint8_t(0));
+            for (int i = -r; i <= r; ++i)
+            {
+                const auto mask = row_mask(wrap(y + i, height));
+                for (int tx = 0; tx < n_tiles_x; ++tx)
+                {
+                    h_mask[tx] |= mask[tx];
+                }
+            }
+            for_each_span(h_mask.data(), [&](int span_begin, int span_end)
+            {
+                for (int x = span_begin - r; x < span_end + r; ++x)
+                {
+                    const int ix = wrap(x, width);
+                    source_row[ix] = pre(ix, y, image(ix, y));
+                }
+                convolve_row_wrap(source_row.data(), out, width, span_begin, span_end, kernel.data(), r);
+            });
+        };
+
+        // strips of whole tile rows, so no two strips update the same non_zero entry
+        const int strip_height = execution.parallel() ? tile_size : height;
+        const int n_strips = (height + strip_height - 1) / strip_height;
+
+        // the rows within r of a strip boundary (wrapping around at the bottom)
+        std::vector<int> boundary_slot(height, -1);
+        std::vector<int> boundary_rows;
+        for (int s = 0; s < n_strips; ++s)
+        {
+            for (int i = -r; i < r; ++i)
+            {
+                const int y = wrap(s * strip_height + i, height);
+                if(boundary_slot[y] < 0)
+                {
+                    boundary_slot[y] = int(boundary_rows.size());
+                    boundary_rows.push_back(y);
+                }
+            }
         }
+        std::vector<V> boundary(boundary_rows.size() * width);
+        parallel_chunks(execution, boundary_rows.size(), [&](std::size_t begin, std::size_t end)
+        {
+            auto scratch = make_row_scratch();
+            for (auto k = begin; k < end; ++k)
+            {
+                horizontal_row(boundary_rows[k], boundary.data() + k * width, scratch);
+            }
+        });
 
-        // --- horizontal pass ---
-        for (int y = 0; y < height; ++y)
+        parallel_chunks(execution, std::size_t(n_strips), [&](std::size_t strip_begin, std::size_t strip_end)
         {
-            for (int x = 0; x < width; ++x)
+            auto scratch = make_row_scratch();
+            std::vector<V> ring(std::size_t(ksize) * width);
+            std::vector<V> acc(width);
+            std::vector<const V *> rows(ksize);
+            for (auto s = int(strip_begin); s < int(strip_end); ++s)
             {
-                T acc = zero<T>::value();
+                const int y_begin = s * strip_height;
+                const int y_end = std::min(y_begin + strip_height, height);
 
-                for (int i = -r; i <= r; ++i)
+                // ring slot of row y, y >= y_begin - r
+                auto slot = [&](int y)
                 {
-                    int ix = wrap(x + i, width);
-                    add_weighted(acc, src_image(ix, y), kernel[i + r]);
-                }
+                    return ring.data() + std::size_t((y - y_begin + r) % ksize) * width;
+                };
+                // rows of other strips and the rows around the wrap come from the
+                // boundary rows, the other rows of the strip have not been written yet
+                auto fetch = [&](int y)
+                {
+                    const int wrapped = wrap(y, height);
+                    if(boundary_slot[wrapped] >= 0)
+                    {
+                        const auto source = boundary.data() + std::size_t(boundary_slot[wrapped]) * width;
+                        std::copy(source, source + width, slot(y));
+                    }
+                    else
+                    {
+                        horizontal_row(wrapped, slot(y), scratch);
+                    }
+                };
 
-                tmp[y * width + x] = acc;
+                for (int y = y_begin - r; y < y_begin + r; ++y)
+                {
+                    fetch(y);
+                }
+                for (int y = y_begin; y < y_end; ++y)
+                {
+                    fetch(y + r);
+                    for (int i = -r; i <= r; ++i)
+                    {
+                        rows[i + r] = slot(y + i);
+                    }
+                    T * out = &image(0, y);
+                    auto non_zero_row = non_zero.data() + std::size_t(y / tile_size) * n_tiles_x;
+                    for_each_span(row_mask(y), [&](int span_begin, int span_end)
+                    {
+                        // tap by tap over the whole span, which vectorizes along x
+                        // and sums each pixel in the same order as a per pixel loop
+                        std::fill(acc.begin() + span_begin, acc.begin() + span_end, zero<V>::value());
+                        for (int i = 0; i < ksize; ++i)
+                        {
+                            const V * row = rows[i];
+                            const K weight = kernel[i];
+                            for (int x = span_begin; x < span_end; ++x)
+                            {
+                                add_weighted(acc[x], row[x], weight);
+                            }
+                        }
+                        for (int tile_begin = span_begin; tile_begin < span_end; tile_begin += tile_size)
+                        {
+                            const int tile_end = std::min(tile_begin + tile_size, span_end);
+                            bool any = false;
+                            for (int x = tile_begin; x < tile_end; ++x)
+                            {
+                                out[x] = post(acc[x], out[x]);
+                                any |= !is_zero(out[x]);
+                            }
+                            non_zero_row[tile_begin / tile_size] |= any;
+                        }
+                    });
+                }
             }
+        });
+        tiles->assign(non_zero);
+    }
+
+    // widths of n box filters which, applied one after another, approximate a
+    // gaussian of sigma. The widths are odd and differ by at most 2 (P. Kovesi,
+    // "Fast almost-gaussian filtering")
+    inline std::vector<int> gaussian_box_widths(double sigma, int n)
+    {
+        const double ideal = std::sqrt(12.0 * sigma * sigma / n + 1.0);
+        int lower = int(std::floor(ideal));
+        if(lower % 2 == 0)
+        {
+            --lower;
+        }
+        lower = std::max(lower, 1);
+        const double m = (12.0 * sigma * sigma - n * lower * lower - 4.0 * n * lower - 3.0 * n) / (-4.0 * lower - 4.0);
+        const int n_lower = std::clamp(int(std::lround(m)), 0, n);
+        std::vector<int> widths(n);
+        for (int i = 0; i < n; ++i)
+        {
+            widths[i] = i < n_lower ? lower : lower + 2;
         }
+        return widths;
+    }
 
-        // --- vertical pass ---
-        for (int y = 0; y < height; ++y)
+    // in place periodic box filters of the given widths, first along the rows,
+    // then along the columns. Running sums make each pass O(1) per pixel,
+    // tmp is a buffer of the same shape. Both need contiguous rows
+    template<typename T>
+    void boxFilterPassesWrap(
+        ImageView2d<T> image,
+        ImageView2d<T> tmp,
+        const std::vector<int> & widths,
+        Execution execution = exec::seq
+    )
+    {
+        using K = gaussian_kernel_type<T>;
+        const auto width = image.shape()[0];
+        const auto height = image.shape()[1];
+        const int n_passes = int(widths.size());
+
+        // rows: each row goes through all passes on its own, wrapping via
+        // a copy extended by the box radius on both sides
+        parallel_chunks(execution, std::size_t(height), [&](std::size_t begin, std::size_t end)
         {
-            for (int x = 0; x < width; ++x)
+            std::vector<T> extended;
+            for (auto y = int(begin); y < int(end); ++y)
             {
-                T acc = zero<T>::value();
-
-                for (int i = -r; i <= r; ++i)
+                T * row = image.row(y);
+                for (const int box : widths)
                 {
-                    int iy = wrap(y + i, height);
-                    add_weighted(acc, tmp[iy * width + x], kernel[i + r]);
+                    const int rb = box / 2;
+                    if(rb == 0)
+                    {
+                        continue;
+                    }
+                    const K weight = K(1) / K(box);
+                    extended.resize(std::size_t(width + 2 * rb));
+                    for (int i = 0; i < width + 2 * rb; ++i)
+                    {
+                        extended[i] = row[wrap(i - rb, width)];
+                    }
+                    T acc = zero<T>::value();
+                    for (int i = 0; i < box; ++i)
+                    {
+                        acc += extended[i];
+                    }
+                    for (int x = 0; x < width; ++x)
+                    {
+                        row[x] = zero<T>::value();
+                        add_weighted(row[x], acc, weight);
+                        if(x + 1 < width)
+                        {
+                            acc += extended[x + box];
+                            acc -= extended[x];
+                        }
+                    }
                 }
+            }
+        });
 
-                dst_image[y * width + x] = static_cast<U>(acc);
+        // columns: blocks of columns go through all passes, alternating between
+        // image and tmp, the running sums are whole row segments so this vectorizes
+        constexpr int block = 256;
+        const int n_blocks = (width + block - 1) / block;
+        parallel_chunks(execution, std::size_t(n_blocks), [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<T> acc(block);
+            for (auto b = int(begin); b < int(end); ++b)
+            {
+                const int x0 = b * block;
+                const int n = std::min(block, width - x0);
+                ImageView2d<T> * src = &image;
+                ImageView2d<T> * dst = &tmp;
+                for (int pass = 0; pass < n_passes; ++pass)
+                {
+                    const int box = widths[pass];
+                    const int rb = box / 2;
+                    if(rb == 0)
+                    {
+                        continue;
+                    }
+                    const K weight = K(1) / K(box);
+                    std::fill(acc.begin(), acc.begin() + n, zero<T>::value());
+                    for (int i = -rb; i <= rb; ++i)
+                    {
+                        const T * row = src->row(wrap(i, height)) + x0;
+                        for (int x = 0; x < n; ++x)
+                        {
+                            acc[x] += row[x];
+                        }
+                    }
+                    for (int y = 0; y < height; ++y)
+                    {
+                        T * out = dst->row(y) + x0;
+                        for (int x = 0; x < n; ++x)
+                        {
+                            out[x] = zero<T>::value();
+                            add_weighted(out[x], acc[x], weight);
+                        }
+                        if(y + 1 < height)
+                        {
+                            const T * entering = src->row(wrap(y + rb + 1, height)) + x0;
+                            const T * leaving = src->row(wrap(y - rb, height)) + x0;
+                            for (int x = 0; x < n; ++x)
+                            {
+                                acc[x] += entering[x];
+                                acc[x] -= leaving[x];
+                            }
+                        }
+                    }
+                    std::swap(src, dst);
+                }
+                if(src != &image)
+                {
+                    for (int y = 0; y < height; ++y)
+                    {
+                        std::copy(tmp.row(y) + x0, tmp.row(y) + x0 + n, image.row(y) + x0);
+                    }
+                }
             }
-        }
+        });
     }
 
+    template<typename T>
+    void boxFilterPassesWrap(
+        Image2d<T>& image,
+        Image2d<T>& tmp,
+        const std::vector<int> & widths,
+        Execution execution = exec::seq
+    )
+    {
+        boxFilterPassesWrap(image.view(), tmp.view(), widths, execution);
+    }
 
+    // periodic approximate gaussian blur by n_passes box filters per direction.
+    // The cost does not depend on sigma, for large sigma it is much cheaper than
+    // gaussianSeparableWrap with a radius of about 3 sigma. The variance matches
+    // sigma^2 up to the rounding of the box widths, which makes it a poor fit
+    // for sigma below about 2. The temporaries come from scratch_arena()
+    template<typename S, class U>
+    void gaussianBoxWrap(
+        ImageView2d<S> src,
+        ImageView2d<U> dst,
+        double sigma,
+        int n_passes = 3,
+        Execution execution = exec::seq
+    )
+    {
+        using T = std::remove_const_t<S>;
+        const auto height = src.shape()[1];
+        auto image = scratch_arena().image<T>(0, src.shape());
+        auto tmp = scratch_arena().image<T>(1, src.shape());
+        parallel_chunks(execution, std::size_t(height), [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<T> buffer;
+            for (auto y = int(begin); y < int(end); ++y)
+            {
+                store_row(image, y, 0, load_row(src, y, buffer), src.shape()[0]);
+            }
+        });
+        boxFilterPassesWrap(image, tmp, gaussian_box_widths(sigma, n_passes), execution);
+        parallel_chunks(execution, std::size_t(height), [&](std::size_t begin, std::size_t end)
+        {
+            for (auto y = int(begin); y < int(end); ++y)
+            {
+                store_row(dst, y, 0, image.row(y), src.shape()[0]);
+            }
+        });
+    }
 
-
-    template<typename T>
-    void gaussianSeparableWrap(
+    template<typename T, class U>
+    void gaussianBoxWrap(
         const Image2d<T>& src_image,
-        Image2d<T>& dst_image,
-        std::size_t kernelR,
-        double sigma
+        Image2d<U>& dst_image,
+        double sigma,
+        int n_passes = 3,
+        Execution execution = exec::seq
     )
     {
-        Image2d<T> tmp(src_image);
-        gaussianSeparableWrap(
-            src_image,
-            tmp,
-            dst_image,
-            kernelR,
-            sigma
-        );
+        gaussianBoxWrap(src_image.view(), dst_image.view(), sigma, n_passes, execution);
+    }
+
+    // gaussianBoxWrap fused with pre and post like gaussianSeparableWrapFused.
+    // The box filters reach far, so all tiles are visited, afterwards the
+    // active set is updated to the tiles holding non zero values
+    template<typename T, class PRE, class POST>
+    void gaussianBoxWrapFused(
+        Image2d<T>& image,
+        double sigma,
+        PRE && pre,
+        POST && post,
+        ActiveTiles * tiles = nullptr,
+        Execution execution = exec::seq,
+        int n_passes = 3
+    )
+    {
+        const auto width = image.shape()[0];
+        const auto height = image.shape()[1];
+        using V = std::decay_t<decltype(pre(0, 0, image(0, 0)))>;
+
+        auto blurred = scratch_arena().image<V>(0, image.shape());
+        auto tmp = scratch_arena().image<V>(1, image.shape());
+        parallel_chunks(execution, std::size_t(height), [&](std::size_t begin, std::size_t end)
+        {
+            for (auto y = int(begin); y < int(end); ++y)
+            {
+                V * row = blurred.row(y);
+                for (int x = 0; x < width; ++x)
+                {
+                    row[x] = pre(x, y, image(x, y));
+                }
+            }
+        });
+
+        boxFilterPassesWrap(blurred, tmp, gaussian_box_widths(sigma, n_passes), execution);
+
+        // strips of whole tile rows, so no two strips update the same non_zero entry
+        const int strip_height = tiles != nullptr ? tiles->tile_size() : 1;
+        const int n_strips = (height + strip_height - 1) / strip_height;
+        std::vector<std::uint8_t> non_zero(tiles != nullptr ? tiles->size() : 0, 0);
+        parallel_chunks(execution, std::size_t(n_strips), [&](std::size_t begin, std::size_t end)
+        {
+            for (auto y = int(begin) * strip_height; y < std::min(int(end) * strip_height, height); ++y)
+            {
+                const V * row = blurred.row(y);
+                for (int x = 0; x < width; ++x)
+                {
+                    auto & pixel = image(x, y);
+                    pixel = post(row[x], pixel);
+                    if(tiles != nullptr && !is_zero(pixel))
+                    {
+                        non_zero[tiles->tile_index(x, y)] = 1;
+                    }
+                }
+            }
+        });
+        if(tiles != nullptr)
+        {
+            tiles->assign(non_zero);
+        }
     }
     
 
+    // brute force disc filter, tests every pixel of the (2r+1)^2 square.
+    // Kept as the reference for discMorphChords
     template<typename T, typename U, class COMPERATOR>
     void discMorphImpl(
         const Image2d<T>& src_image,
@@ -355,84 +1003,214 @@ namespace dtks{
         }
     }
     
+    // half widths of the horizontal chords of a disc: the disc holds the pixels
+    // (dx, dy) with |dx| <= half_widths[dy + r], i.e. dx*dx + dy*dy <= r*r
+    inline std::vector<int> disc_chord_half_widths(int r)
+    {
+        std::vector<int> half_widths(2 * r + 1, 0);
+        for (int dy = -r; dy <= r; ++dy)
+        {
+            int h = 0;
+            while((h + 1) * (h + 1) + dy * dy <= r * r)
+            {
+                ++h;
+            }
+            half_widths[dy + r] = h;
+        }
+        return half_widths;
+    }
+
+    // out[x] = the extreme (by comparator) of in[x - h] ... in[x + h], clipped to [0, n).
+    // van Herk / Gil-Werman: prefix and suffix extremes within blocks of the window
+    // width, 3 comparisons per pixel for any h. Clipping is done by repeating the
+    // border pixels, which are part of every clipped window anyway
+    template<class T, class COMPERATOR>
+    void running_extreme(const T * in, T * out, int n, int h, COMPERATOR comparator, std::vector<T> & scratch)
+    {
+        const int w = 2 * h + 1;
+        const int length = ((n + 2 * h + w - 1) / w) * w;
+        scratch.resize(3 * std::size_t(length));
+        T * padded = scratch.data();
+        T * prefix = padded + length;
+        T * suffix = prefix + length;
+        for (int j = 0; j < length; ++j)
+        {
+            padded[j] = in[std::clamp(j - h, 0, n - 1)];
+        }
+        auto pick = [&](const T & a, const T & b)
+        {
+            return comparator(b, a) ? b : a;
+        };
+        for (int block = 0; block < length; block += w)
+        {
+            prefix[block] = padded[block];
+            for (int j = block + 1; j < block + w; ++j)
+            {
+                prefix[j] = pick(prefix[j - 1], padded[j]);
+            }
+            suffix[block + w - 1] = padded[block + w - 1];
+            for (int j = block + w - 2; j >= block; --j)
+            {
+                suffix[j] = pick(suffix[j + 1], padded[j]);
+            }
+        }
+        for (int x = 0; x < n; ++x)
+        {
+            out[x] = pick(suffix[x], prefix[x + w - 1]);
+        }
+    }
+
+    // same result as discMorphImpl (pixels outside the image are ignored), but the
+    // disc is split into its 2r+1 horizontal chords and each chord is a 1d running
+    // extreme: O(r) instead of O(r^2) per pixel. Rows are split across the threads.
+    // The results are identical for integer pixels and floats without NaN.
+    // src and dst may be strided but must not overlap
+    template<typename S, typename U, class COMPERATOR>
+    void discMorphChords(
+        ImageView2d<S> src,
+        ImageView2d<U> dst,
+        int radius,
+        COMPERATOR comparator,
+        Execution execution = exec::seq
+    )
+    {
+        using T = std::remove_const_t<S>;
+        const int r = std::max(radius, 0);
+        const auto width = src.shape()[0];
+        const auto height = src.shape()[1];
+        const auto half_widths = disc_chord_half_widths(r);
+
+        parallel_chunks(execution, std::size_t(height), [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<T> chord(width);
+            std::vector<T> acc(width);
+            std::vector<T> scratch;
+            std::vector<T> buffer;
+            for (auto y = int(begin); y < int(end); ++y)
+            {
+                const T * center = load_row(src, y, buffer);
+                std::copy(center, center + width, acc.begin());
+                for (int dy = -r; dy <= r; ++dy)
+                {
+                    const int sy = y + dy;
+                    if(sy < 0 || sy >= height)
+                    {
+                        continue;
+                    }
+                    const T * row = load_row(src, sy, buffer);
+                    const int h = half_widths[dy + r];
+                    if(h > 0)
+                    {
+                        running_extreme(row, chord.data(), width, h, comparator, scratch);
+                        row = chord.data();
+                    }
+                    for (int x = 0; x < width; ++x)
+                    {
+                        acc[x] = comparator(row[x], acc[x]) ? row[x] : acc[x];
+                    }
+                }
+                store_row(dst, y, 0, acc.data(), width);
+            }
+        });
+    }
+
+    template<typename T, typename U, class COMPERATOR>
+    void discMorphChords(
+        const Image2d<T>& src_image,
+        Image2d<U>& dst_image,
+        int radius,
+        COMPERATOR comparator,
+        Execution execution = exec::seq
+    )
+    {
+        discMorphChords(src_image.view(), dst_image.view(), radius, comparator, execution);
+    }
+
+    template<typename S, typename U>
+    void discErosion(
+        ImageView2d<S> src,
+        ImageView2d<U> dst,
+        int radius,
+        Execution execution = exec::seq
+    ){
+        discMorphChords(src, dst, radius, std::less<std::remove_const_t<S>>(), execution);
+    }
+
+    template<typename S, typename U>
+    void discDilation(
+        ImageView2d<S> src,
+        ImageView2d<U> dst,
+        int radius,
+        Execution execution = exec::seq
+    ){
+        discMorphChords(src, dst, radius, std::greater<std::remove_const_t<S>>(), execution);
+    }
+
+    // the intermediate image comes from scratch_arena()
+    template<typename S, typename U>
+    void discOpening(
+        ImageView2d<S> src,
+        ImageView2d<U> dst,
+        int radius,
+        Execution execution = exec::seq
+    ){
+        using T = std::remove_const_t<S>;
+        auto temp = scratch_arena().image<T>(0, src.shape());
+        discMorphChords(src, temp, radius, std::less<T>(), execution);
+        discMorphChords(temp, dst, radius, std::greater<T>(), execution);
+    }
+
+    template<typename S, typename U>
+    void discClosing(
+        ImageView2d<S> src,
+        ImageView2d<U> dst,
+        int radius,
+        Execution execution = exec::seq
+    ){
+        using T = std::remove_const_t<S>;
+        auto temp = scratch_arena().image<T>(0, src.shape());
+        discMorphChords(src, temp, radius, std::greater<T>(), execution);
+        discMorphChords(temp, dst, radius, std::less<T>(), execution);
+    }
+
     template<typename T, typename U>
     void discErosion(
         const Image2d<T>& src_image,
         Image2d<U>& dst_image,
-        int radius
+        int radius,
+        Execution execution = exec::seq
     ){
-        Image2d<T> temp_image(src_image.shape());
-        discMorphImpl(
-            src_image,
-            temp_image,
-            dst_image,
-            radius,
-            std::less<T>()
-        );
+        discErosion(src_image.view(), dst_image.view(), radius, execution);
     }
 
     template<typename T, typename U>
     void discDilation(
         const Image2d<T>& src_image,
         Image2d<U>& dst_image,
-        int radius
+        int radius,
+        Execution execution = exec::seq
     ){
-        Image2d<T> temp_image(src_image.shape());
-        discMorphImpl(
-            src_image,
-            temp_image,
-            dst_image,
-            radius,
-            std::greater<T>()
-        );
+        discDilation(src_image.view(), dst_image.view(), radius, execution);
     }
 
     template<typename T, typename U>
     void discOpening(
         const Image2d<T>& src_image,
         Image2d<U>& dst_image,
-        int radius
+        int radius,
+        Execution execution = exec::seq
     ){
-        Image2d<T> temp_image1(src_image.shape());
-        Image2d<T> temp_image2(src_image.shape());
-        discMorphImpl(
-            src_image,
-            temp_image1,
-            temp_image2,
-            radius,
-            std::less<T>()
-        );
-        discMorphImpl(
-            temp_image2,
-            temp_image1,
-            dst_image,
-            radius,
-            std::greater<T>()
-        );
+        discOpening(src_image.view(), dst_image.view(), radius, execution);
     }
 
     template<typename T, typename U>
     void discClosing(
         const Image2d<T>& src_image,
         Image2d<U>& dst_image,
-        int radius
+        int radius,
+        Execution execution = exec::seq
     ){      
-        Image2d<T> temp_image1(src_image.shape());
-        Image2d<T> temp_image2(src_image.shape());
-        discMorphImpl(
-            src_image,
-            temp_image1,
-            temp_image2,
-            radius,
-            std::greater<T>()
-        );
-        discMorphImpl(
-            temp_image2,
-            temp_image1,
-            dst_image,
-            radius,
-            std::less<T>()
-        );
+        discClosing(src_image.view(), dst_image.view(), radius, execution);
     }
 
 
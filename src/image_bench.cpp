@@ -0,0 +1,470 @@
+#include "image.hpp"
+#include "bench_args.hpp"
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+
+// headless benchmark for the image operations.
+// usage: image_bench [size] [radius]
+// times the disc morphology against the brute force reference on a
+// size x size terrain mask.
+//
+// usage: image_bench --check
+// compares discErosion / discDilation / discOpening / discClosing against
+// the brute force discMorphImpl on random images, and gaussianSeparableWrap /
+// gaussianSeparableWrapFused (with and without tiles) against the plain per
+// pixel gaussian, sequential and with a pool. The box filter gaussian has to
+// keep the mass and the variance of the box widths, give the same result with
+// a pool and when fused. add / subtract / multiply / divide, channel_min_max
+// and parallel_reduce have to match their sequential results with a pool.
+// Returns 1 on mismatch.
+
+namespace
+{
+    // blobs of land, like the terrain masks the ants run on
+    dtks::Image2d<std::uint8_t> make_mask(std::array<int, 2> shape, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        dtks::Image2d<std::uint8_t> mask(shape, 0);
+        std::uniform_int_distribution<int> x_dist(0, shape[0] - 1);
+        std::uniform_int_distribution<int> y_dist(0, shape[1] - 1);
+        std::uniform_int_distribution<int> radius_dist(1, std::max(2, std::min(shape[0], shape[1]) / 6));
+        for(int blob = 0; blob < 20; ++blob)
+        {
+            const int cx = x_dist(generator);
+            const int cy = y_dist(generator);
+            const int r = radius_dist(generator);
+            for(int y = std::max(0, cy - r); y < std::min(shape[1], cy + r + 1); ++y)
+            {
+                for(int x = std::max(0, cx - r); x < std::min(shape[0], cx + r + 1); ++x)
+                {
+                    if((x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r)
+                    {
+                        mask(x, y) = 1;
+                    }
+                }
+            }
+        }
+        return mask;
+    }
+
+    template<class T>
+    dtks::Image2d<T> make_noise(std::array<int, 2> shape, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<int> dist(0, 200);
+        dtks::Image2d<T> image(shape);
+        for(std::size_t i = 0; i < image.size(); ++i)
+        {
+            image[i] = T(dist(generator)) / T(4);
+        }
+        return image;
+    }
+
+    template<class T, class COMPERATOR>
+    dtks::Image2d<T> reference(const dtks::Image2d<T> & image, int radius, COMPERATOR comparator)
+    {
+        dtks::Image2d<T> temp(image.shape());
+        dtks::Image2d<T> result(image.shape());
+        dtks::discMorphImpl(image, temp, result, radius, comparator);
+        return result;
+    }
+
+    template<class T>
+    bool same(const dtks::Image2d<T> & a, const dtks::Image2d<T> & b)
+    {
+        for(std::size_t i = 0; i < a.size(); ++i)
+        {
+            if(a[i] != b[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<class T>
+    int check_image(const dtks::Image2d<T> & image, int radius, dtks::ThreadPool * pool, const std::string & name)
+    {
+        const auto eroded = reference(image, radius, std::less<T>());
+        const auto dilated = reference(image, radius, std::greater<T>());
+        const auto opened = reference(eroded, radius, std::greater<T>());
+        const auto closed = reference(dilated, radius, std::less<T>());
+
+        dtks::Image2d<T> result(image.shape());
+        int n_failed = 0;
+        auto expect = [&](const dtks::Image2d<T> & expected, const char * op)
+        {
+            if(!same(result, expected))
+            {
+                ++n_failed;
+                std::cout<<"FAILED "<<op<<" "<<name<<" "<<image.shape()[0]<<"x"<<image.shape()[1]
+                    <<" radius "<<radius<<(pool ? " with pool" : "")<<"\n";
+            }
+        };
+        dtks::discErosion(image, result, radius, pool);
+        expect(eroded, "erosion");
+        dtks::discDilation(image, result, radius, pool);
+        expect(dilated, "dilation");
+        dtks::discOpening(image, result, radius, pool);
+        expect(opened, "opening");
+        dtks::discClosing(image, result, radius, pool);
+        expect(closed, "closing");
+        return n_failed;
+    }
+
+    // the per pixel periodic gaussian, both passes wrap every tap
+    dtks::Image2d<double> reference_gaussian(const dtks::Image2d<double> & image, int r, double sigma)
+    {
+        const auto width = image.shape()[0];
+        const auto height = image.shape()[1];
+        std::vector<double> kernel(2 * r + 1);
+        double sum = 0.0;
+        for(int i = -r; i <= r; ++i)
+        {
+            kernel[i + r] = std::exp(-(i * i) / (2.0 * sigma * sigma));
+            sum += kernel[i + r];
+        }
+        for(auto & v : kernel)
+        {
+            v /= sum;
+        }
+        dtks::Image2d<double> tmp(image.shape());
+        dtks::Image2d<double> result(image.shape());
+        for(int y = 0; y < height; ++y)
+        {
+            for(int x = 0; x < width; ++x)
+            {
+                double acc = 0.0;
+                for(int i = -r; i <= r; ++i)
+                {
+                    acc += image(wrap(x + i, width), y) * kernel[i + r];
+                }
+                tmp(x, y) = acc;
+            }
+        }
+        for(int y = 0; y < height; ++y)
+        {
+            for(int x = 0; x < width; ++x)
+            {
+                double acc = 0.0;
+                for(int i = -r; i <= r; ++i)
+                {
+                    acc += tmp(x, wrap(y + i, height)) * kernel[i + r];
+                }
+                result(x, y) = acc;
+            }
+        }
+        return result;
+    }
+
+    // zero but for a few pixels, so most tiles stay inactive
+    dtks::Image2d<double> make_sparse(std::array<int, 2> shape, unsigned seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<int> x_dist(0, shape[0] - 1);
+        std::uniform_int_distribution<int> y_dist(0, shape[1] - 1);
+        dtks::Image2d<double> image(shape, 0.0);
+        for(int i = 0; i < 3; ++i)
+        {
+            image(x_dist(generator), y_dist(generator)) = 1.0 + i;
+        }
+        return image;
+    }
+
+    int check_gaussian(std::array<int, 2> shape, int r, dtks::ThreadPool * pool)
+    {
+        const double sigma = 0.3 + r / 3.0;
+        const auto pre = [](int, int, double value){ return value; };
+        const auto post = [](double blurred, double){ return blurred; };
+        int n_failed = 0;
+        auto expect = [&](const dtks::Image2d<double> & result, const dtks::Image2d<double> & expected, const std::string & op)
+        {
+            if(!same(result, expected))
+            {
+                ++n_failed;
+                std::cout<<"FAILED "<<op<<" "<<shape[0]<<"x"<<shape[1]
+                    <<" radius "<<r<<(pool ? " with pool" : "")<<"\n";
+            }
+        };
+
+        const auto image = make_noise<double>(shape, 5);
+        const auto expected = reference_gaussian(image, r, sigma);
+        dtks::Image2d<double> result(shape);
+        dtks::gaussianSeparableWrap(image, result, std::size_t(r), sigma, pool);
+        expect(result, expected, "gaussianSeparableWrap");
+        result = image;
+        dtks::gaussianSeparableWrap(result, result, std::size_t(r), sigma, pool);
+        expect(result, expected, "gaussianSeparableWrap in place");
+        result = image;
+        dtks::gaussianSeparableWrapFused(result, std::size_t(r), sigma, pre, post, nullptr, pool);
+        expect(result, expected, "gaussianSeparableWrapFused");
+
+        // two steps on a sparse image: the second one only visits the tiles
+        // the first one left non zero
+        const auto sparse = make_sparse(shape, 6);
+        const auto expected_sparse = reference_gaussian(reference_gaussian(sparse, r, sigma), r, sigma);
+        for(int tile_size : {1, 4, 16})
+        {
+            dtks::ActiveTiles tiles(shape, tile_size);
+            for(int y = 0; y < shape[1]; ++y)
+            {
+                for(int x = 0; x < shape[0]; ++x)
+                {
+                    if(sparse(x, y) != 0.0)
+                    {
+                        tiles.activate(x, y);
+                    }
+                }
+            }
+            result = sparse;
+            dtks::gaussianSeparableWrapFused(result, std::size_t(r), sigma, pre, post, &tiles, pool);
+            dtks::gaussianSeparableWrapFused(result, std::size_t(r), sigma, pre, post, &tiles, pool);
+            expect(result, expected_sparse, "gaussianSeparableWrapFused tiles " + std::to_string(tile_size));
+        }
+        return n_failed;
+    }
+
+    int check_box_gaussian(double sigma, dtks::ThreadPool * pool)
+    {
+        int n_failed = 0;
+        auto fail = [&](const std::string & what)
+        {
+            ++n_failed;
+            std::cout<<"FAILED box gaussian "<<what<<" sigma "<<sigma<<(pool ? " with pool" : "")<<"\n";
+        };
+
+        // impulse response: mass 1, and per axis the variance of the boxes,
+        // sum (w^2 - 1) / 12. Rounding the number of narrow boxes moves that
+        // variance by at most (w_narrow + 1) / 6 from sigma^2
+        const std::array<int, 2> shape = {160, 144};
+        const int cx = 70;
+        const int cy = 61;
+        dtks::Image2d<double> impulse(shape, 0.0);
+        impulse(cx, cy) = 1.0;
+        dtks::Image2d<double> response(shape);
+        dtks::gaussianBoxWrap(impulse, response, sigma, 3, pool);
+        const auto widths = dtks::gaussian_box_widths(sigma, 3);
+        double box_variance = 0.0;
+        for(const int w : widths)
+        {
+            box_variance += (w * w - 1) / 12.0;
+        }
+        double mass = 0.0;
+        double variance_x = 0.0;
+        double variance_y = 0.0;
+        for(int y = 0; y < shape[1]; ++y)
+        {
+            for(int x = 0; x < shape[0]; ++x)
+            {
+                mass += response(x, y);
+                variance_x += response(x, y) * (x - cx) * (x - cx);
+                variance_y += response(x, y) * (y - cy) * (y - cy);
+            }
+        }
+        if(std::abs(mass - 1.0) > 1e-9)
+        {
+            fail("mass " + std::to_string(mass));
+        }
+        if(std::abs(variance_x - box_variance) > 1e-6 || std::abs(variance_y - box_variance) > 1e-6)
+        {
+            fail("variance " + std::to_string(variance_x) + " " + std::to_string(variance_y)
+                + " of boxes " + std::to_string(box_variance));
+        }
+        if(std::abs(box_variance - sigma * sigma) > (widths.front() + 1) / 6.0 + 1e-9)
+        {
+            fail("standard deviation " + std::to_string(std::sqrt(box_variance)));
+        }
+
+        // with a pool, and fused with tiles, the result stays the same
+        const std::array<int, 2> noise_shape = {97, 41};
+        const auto image = make_noise<double>(noise_shape, 7);
+        dtks::Image2d<double> expected(noise_shape);
+        dtks::gaussianBoxWrap(image, expected, sigma);
+        dtks::Image2d<double> result(noise_shape);
+        dtks::gaussianBoxWrap(image, result, sigma, 3, pool);
+        if(!same(result, expected))
+        {
+            fail("gaussianBoxWrap");
+        }
+        dtks::ActiveTiles tiles(noise_shape, 16);
+        tiles.activate_all();
+        result = image;
+        dtks::gaussianBoxWrapFused(result, sigma,
+            [](int, int, double value){ return value; },
+            [](double blurred, double){ return blurred; },
+            &tiles, pool);
+        if(!same(result, expected))
+        {
+            fail("gaussianBoxWrapFused");
+        }
+        return n_failed;
+    }
+
+    int check_execution(std::size_t n, dtks::ThreadPool & pool)
+    {
+        int n_failed = 0;
+        auto fail = [&](const std::string & what)
+        {
+            ++n_failed;
+            std::cout<<"FAILED "<<what<<" with pool, n = "<<n<<"\n";
+        };
+
+        const std::array<int, 2> shape = {int(n), 1};
+        const auto image = make_noise<double>(shape, 8);
+        auto elementwise = [&](const char * name, auto && op)
+        {
+            auto expected = image;
+            auto result = image;
+            op(expected, dtks::exec::seq);
+            op(result, dtks::Execution(&pool));
+            if(!same(result, expected))
+            {
+                fail(name);
+            }
+        };
+        elementwise("add", [](auto & img, dtks::Execution e){ dtks::add(img, 1.5, e); });
+        elementwise("subtract", [](auto & img, dtks::Execution e){ dtks::subtract(img, 0.25, e); });
+        elementwise("multiply", [](auto & img, dtks::Execution e){ dtks::multiply(img, 0.3, e); });
+        elementwise("divide", [](auto & img, dtks::Execution e){ dtks::divide(img, 7.0, e); });
+
+        dtks::MultiChannelImage2d<float, 2> channels(shape);
+        std::mt19937 generator(9);
+        std::uniform_real_distribution<float> dist(-100.0f, 100.0f);
+        for(std::size_t i = 0; i < channels.size(); ++i)
+        {
+            channels[i] = {dist(generator), dist(generator)};
+        }
+        if(dtks::channel_min_max(channels, &pool) != dtks::channel_min_max(channels))
+        {
+            fail("channel_min_max");
+        }
+
+        // the chunks only depend on n and the pool size, so even a floating
+        // point sum is the same on every run
+        auto sum = [&](dtks::Execution execution)
+        {
+            return dtks::parallel_reduce(execution, image.size(), 0.0,
+                [&](std::size_t begin, std::size_t end)
+                {
+                    double partial = 0.0;
+                    for(std::size_t i = begin; i < end; ++i)
+                    {
+                        partial += image[i];
+                    }
+                    return partial;
+                },
+                [](double a, double b){ return a + b; });
+        };
+        auto count = [&](dtks::Execution execution)
+        {
+            return dtks::parallel_reduce(execution, n, std::size_t(0),
+                [](std::size_t begin, std::size_t end){ return end - begin; },
+                [](std::size_t a, std::size_t b){ return a + b; });
+        };
+        const double first = sum(&pool);
+        if(sum(&pool) != first || std::abs(first - sum(dtks::exec::seq)) > 1e-9 * (1.0 + std::abs(first)))
+        {
+            fail("parallel_reduce sum");
+        }
+        if(count(&pool) != n || count(dtks::exec::seq) != n)
+        {
+            fail("parallel_reduce count");
+        }
+        return n_failed;
+    }
+
+    int check()
+    {
+        const std::array<int, 2> shapes[] = {
+            {1, 1},
+            {1, 17},
+            {13, 1},
+            {31, 23},
+            {64, 64},
+            {97, 41}
+        };
+        dtks::ThreadPool pool(3);
+        int n_failed = 0;
+        for(const auto & shape : shapes)
+        {
+            for(int radius : {0, 1, 2, 3, 5, 8, 13, 40})
+            {
+                for(dtks::ThreadPool * p : {static_cast<dtks::ThreadPool *>(nullptr), &pool})
+                {
+                    n_failed += check_image(make_mask(shape, 1), radius, p, "mask");
+                    n_failed += check_image(make_noise<std::uint8_t>(shape, 2), radius, p, "uint8");
+                    n_failed += check_image(make_noise<float>(shape, 3), radius, p, "float");
+                    n_failed += check_image(make_noise<double>(shape, 4), radius, p, "double");
+                }
+            }
+        }
+        std::cout<<(n_failed == 0 ? "all morphology checks passed" : "morphology checks failed")<<"\n";
+
+        int n_failed_gaussian = 0;
+        for(const auto & shape : {std::array<int, 2>{5, 3}, std::array<int, 2>{1, 1}, std::array<int, 2>{1, 17},
+            std::array<int, 2>{13, 1}, std::array<int, 2>{31, 23}, std::array<int, 2>{97, 41}})
+        {
+            for(int radius = 0; radius <= 40; ++radius)
+            {
+                for(dtks::ThreadPool * p : {static_cast<dtks::ThreadPool *>(nullptr), &pool})
+                {
+                    n_failed_gaussian += check_gaussian(shape, radius, p);
+                }
+            }
+        }
+        for(double sigma : {2.0, 3.5, 8.0})
+        {
+            for(dtks::ThreadPool * p : {static_cast<dtks::ThreadPool *>(nullptr), &pool})
+            {
+                n_failed_gaussian += check_box_gaussian(sigma, p);
+            }
+        }
+        std::cout<<(n_failed_gaussian == 0 ? "all gaussian checks passed" : "gaussian checks failed")<<"\n";
+        n_failed += n_failed_gaussian;
+
+        int n_failed_execution = 0;
+        for(std::size_t n : {1, 2, 3, 11, 1000, 100003})
+        {
+            n_failed_execution += check_execution(n, pool);
+        }
+        std::cout<<(n_failed_execution == 0 ? "all execution checks passed" : "execution checks failed")<<"\n";
+        n_failed += n_failed_execution;
+        return n_failed == 0 ? 0 : 1;
+    }
+
+    template<class F>
+    double milliseconds(F && f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return check();
+    }
+
+    int size = 512;
+    int radius = 20;
+    if(!dtks::parse_counts(argc, argv, "image_bench [size] [radius] | --check", size, radius))
+    {
+        return 2;
+    }
+
+    const auto mask = make_mask({size, size}, 1);
+    dtks::Image2d<std::uint8_t> result(mask.shape());
+    dtks::Image2d<std::uint8_t> temp(mask.shape());
+    const auto chords = milliseconds([&]{ dtks::discErosion(mask, result, radius); });
+    const auto brute_force = milliseconds([&]{ dtks::discMorphImpl(mask, temp, result, radius, std::less<std::uint8_t>()); });
+    std::cout<<"disc erosion "<<size<<"x"<<size<<" radius "<<radius
+        <<"  chords "<<chords<<" ms  brute force "<<brute_force<<" ms  speedup "<<brute_force / chords<<"\n";
+}
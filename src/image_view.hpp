@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace dtks{
+
+    // non owning view of a 2d image with strides in elements, e.g. over the
+    // buffer of a NumPy array or of an Image2d (Image2d::view()). T may be const.
+    // Pixel (x, y) lives at data[x * strides[0] + y * strides[1]]. With
+    // strides[0] == 1 the rows are contiguous and row(y) points to them
+    template<class T>
+    class ImageView2d{
+        public:
+        using value_type = std::remove_const_t<T>;
+
+        ImageView2d() = default;
+
+        // dense row major pixels, like Image2d
+        ImageView2d(T * data, std::array<int, 2> shape)
+        :   data_(data),
+            shape_(shape),
+            strides_{1, shape[0]}
+        {
+        }
+
+        ImageView2d(T * data, std::array<int, 2> shape, std::array<std::ptrdiff_t, 2> strides)
+        :   data_(data),
+            shape_(shape),
+            strides_(strides)
+        {
+        }
+
+        // a view of const pixels from a view of mutable ones
+        template<class U, class = std::enable_if_t<std::is_same_v<const U, T> && !std::is_same_v<U, T>>>
+        ImageView2d(const ImageView2d<U> & other)
+        :   data_(other.data()),
+            shape_(other.shape()),
+            strides_(other.strides())
+        {
+        }
+
+        T & operator()(int x, int y) const
+        {
+            return data_[x * strides_[0] + y * strides_[1]];
+        }
+
+        T * row(int y) const
+        {
+            return data_ + y * strides_[1];
+        }
+
+        bool contiguous_rows() const
+        {
+            return strides_[0] == 1;
+        }
+
+        const std::array<int, 2> & shape() const
+        {
+            return shape_;
+        }
+
+        const std::array<std::ptrdiff_t, 2> & strides() const
+        {
+            return strides_;
+        }
+
+        std::size_t size() const
+        {
+            return std::size_t(shape_[0]) * std::size_t(shape_[1]);
+        }
+
+        T * data() const
+        {
+            return data_;
+        }
+
+        private:
+        T * data_ = nullptr;
+        std::array<int, 2> shape_ = {0, 0};
+        std::array<std::ptrdiff_t, 2> strides_ = {1, 0};
+    };
+
+    // the pixels of row y, gathered into buffer if the row is strided
+    template<class T>
+    const std::remove_const_t<T> * load_row(const ImageView2d<T> & view, int y, std::vector<std::remove_const_t<T>> & buffer)
+    {
+        if(view.contiguous_rows())
+        {
+            return view.row(y);
+        }
+        buffer.resize(std::size_t(view.shape()[0]));
+        for(int x = 0; x < view.shape()[0]; ++x)
+        {
+            buffer[x] = view(x, y);
+        }
+        return buffer.data();
+    }
+
+    // view(x0 + i, y) = static_cast<U>(values[i]) for i in [0, n)
+    template<class U, class T>
+    void store_row(const ImageView2d<U> & view, int y, int x0, const T * values, int n)
+    {
+        if(view.contiguous_rows())
+        {
+            U * out = view.row(y) + x0;
+            for(int i = 0; i < n; ++i)
+            {
+                out[i] = static_cast<U>(values[i]);
+            }
+        }
+        else
+        {
+            for(int i = 0; i < n; ++i)
+            {
+                view(x0 + i, y) = static_cast<U>(values[i]);
+            }
+        }
+    }
+
+} // namespace dtks
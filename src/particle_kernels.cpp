@@ -0,0 +1,529 @@
+#include "particle_kernels.hpp"
+#include "force_table.hpp"
+
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DTKS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace dtks{
+
+    namespace
+    {
+        // CONTIGUOUS: neighbors are begin ... begin + n - 1, otherwise indices[0] ... indices[n - 1]
+        template<bool CONTIGUOUS>
+        inline std::size_t neighbor(std::size_t begin, const std::uint32_t * indices, std::size_t k)
+        {
+            if constexpr(CONTIGUOUS)
+            {
+                return begin + k;
+            }
+            else
+            {
+                return indices[k];
+            }
+        }
+
+        // TABLE: look up the forces in params.table instead of evaluating force_curve
+        template<bool CONTIGUOUS, bool TABLE>
+        void pair_force_scalar(
+            const PairForceParams & params,
+            const float * nx,
+            const float * ny,
+            const std::uint8_t * ntype,
+            std::size_t begin,
+            const std::uint32_t * indices,
+            std::size_t n,
+            float x,
+            float y,
+            float & fx,
+            float & fy
+        )
+        {
+            float force_x = fx;
+            float force_y = fy;
+            for(std::size_t k = 0; k < n; ++k)
+            {
+                const auto j = neighbor<CONTIGUOUS>(begin, indices, k);
+                float diff_x = nx[j] - x;
+                float diff_y = ny[j] - y;
+                // apply periodic boundary conditions
+                if(diff_x > params.shape_x / 2.0f)
+                    diff_x -= params.shape_x;
+                else if(diff_x < -params.shape_x / 2.0f)
+                    diff_x += params.shape_x;
+                if(diff_y > params.shape_y / 2.0f)
+                    diff_y -= params.shape_y;
+                else if(diff_y < -params.shape_y / 2.0f)
+                    diff_y += params.shape_y;
+
+                const float dist_sq = diff_x*diff_x + diff_y*diff_y;
+                if(TABLE && dist_sq < params.range_sq)
+                {
+                    const float h = ForceTable::lookup(params.table + ntype[j] * params.table_stride, dist_sq * params.table_scale);
+                    force_x += h * diff_x;
+                    force_y += h * diff_y;
+                }
+                else if(!TABLE && dist_sq < params.range_sq)
+                {
+                    const float dist = std::sqrt(dist_sq) + 1e-6f;
+                    const float a = params.strength[ntype[j] * params.strength_stride];
+                    const float force_magnitude = force_curve(dist / params.range, a, params.beta);
+                    force_x += force_magnitude * (params.range * (diff_x / dist));
+                    force_y += force_magnitude * (params.range * (diff_y / dist));
+                }
+            }
+            fx = force_x;
+            fy = force_y;
+        }
+
+        #ifdef DTKS_X86_DISPATCH
+
+        struct Avx2Constants
+        {
+            __attribute__((target("avx2,fma")))
+            Avx2Constants(const PairForceParams & params, float x, float y)
+            :   x(_mm256_set1_ps(x)),
+                y(_mm256_set1_ps(y)),
+                shape_x(_mm256_set1_ps(params.shape_x)),
+                shape_y(_mm256_set1_ps(params.shape_y)),
+                half_x(_mm256_set1_ps(params.shape_x / 2.0f)),
+                half_y(_mm256_set1_ps(params.shape_y / 2.0f)),
+                neg_half_x(_mm256_set1_ps(-params.shape_x / 2.0f)),
+                neg_half_y(_mm256_set1_ps(-params.shape_y / 2.0f)),
+                range(_mm256_set1_ps(params.range)),
+                range_sq(_mm256_set1_ps(params.range_sq)),
+                beta(_mm256_set1_ps(params.beta)),
+                inv_beta(_mm256_set1_ps(1.0f / params.beta)),
+                inv_one_minus_beta(_mm256_set1_ps(1.0f / (1.0f - params.beta))),
+                one_plus_beta(_mm256_set1_ps(1.0f + params.beta)),
+                one(_mm256_set1_ps(1.0f)),
+                two(_mm256_set1_ps(2.0f)),
+                eps(_mm256_set1_ps(1e-6f)),
+                abs_mask(_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))),
+                stride(_mm256_set1_epi32(params.strength_stride)),
+                table_scale(_mm256_set1_ps(params.table_scale)),
+                table_max(_mm256_set1_ps(float(params.table_stride - 2))),
+                table_stride(_mm256_set1_epi32(params.table_stride))
+            {
+            }
+            __m256 x, y, shape_x, shape_y, half_x, half_y, neg_half_x, neg_half_y;
+            __m256 range, range_sq, beta, inv_beta, inv_one_minus_beta, one_plus_beta, one, two, eps, abs_mask;
+            __m256i stride;
+            __m256 table_scale, table_max;
+            __m256i table_stride;
+        };
+
+        // force of 8 neighbors at (nx, ny) with types `types`
+        template<bool TABLE>
+        __attribute__((target("avx2,fma")))
+        inline void pair_force_block_avx2(
+            const Avx2Constants & c,
+            const PairForceParams & params,
+            __m256 nx,
+            __m256 ny,
+            __m256i types,
+            __m256 & acc_x,
+            __m256 & acc_y
+        )
+        {
+            __m256 diff_x = _mm256_sub_ps(nx, c.x);
+            __m256 diff_y = _mm256_sub_ps(ny, c.y);
+
+            // minimum image without branches
+            const __m256 above_x = _mm256_and_ps(_mm256_cmp_ps(diff_x, c.half_x, _CMP_GT_OQ), c.shape_x);
+            const __m256 below_x = _mm256_and_ps(_mm256_cmp_ps(diff_x, c.neg_half_x, _CMP_LT_OQ), c.shape_x);
+            const __m256 above_y = _mm256_and_ps(_mm256_cmp_ps(diff_y, c.half_y, _CMP_GT_OQ), c.shape_y);
+            const __m256 below_y = _mm256_and_ps(_mm256_cmp_ps(diff_y, c.neg_half_y, _CMP_LT_OQ), c.shape_y);
+            diff_x = _mm256_add_ps(_mm256_sub_ps(diff_x, above_x), below_x);
+            diff_y = _mm256_add_ps(_mm256_sub_ps(diff_y, above_y), below_y);
+
+            const __m256 dist_sq = _mm256_fmadd_ps(diff_x, diff_x, _mm256_mul_ps(diff_y, diff_y));
+            const __m256 in_range = _mm256_cmp_ps(dist_sq, c.range_sq, _CMP_LT_OQ);
+            if(_mm256_movemask_ps(in_range) == 0)
+            {
+                return;
+            }
+
+            if constexpr(TABLE)
+            {
+                // interpolate the table, lanes out of range are clamped to stay in bounds
+                const __m256 t = _mm256_min_ps(_mm256_mul_ps(dist_sq, c.table_scale), c.table_max);
+                const __m256i k = _mm256_cvttps_epi32(t);
+                const __m256 frac = _mm256_sub_ps(t, _mm256_cvtepi32_ps(k));
+                const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(types, c.table_stride), k);
+                const __m256 h0 = _mm256_i32gather_ps(params.table, index, 4);
+                const __m256 h1 = _mm256_i32gather_ps(params.table + 1, index, 4);
+                const __m256 h = _mm256_and_ps(_mm256_fmadd_ps(frac, _mm256_sub_ps(h1, h0), h0), in_range);
+                acc_x = _mm256_fmadd_ps(h, diff_x, acc_x);
+                acc_y = _mm256_fmadd_ps(h, diff_y, acc_y);
+                return;
+            }
+
+            const __m256 dist = _mm256_add_ps(_mm256_sqrt_ps(dist_sq), c.eps);
+            const __m256 r = _mm256_div_ps(dist, c.range);
+
+            // gather the interaction strengths for the neighbor types
+            const __m256 a = _mm256_i32gather_ps(params.strength, _mm256_mullo_epi32(types, c.stride), 4);
+
+            // branchless force curve
+            const __m256 repulsion = _mm256_fmsub_ps(r, c.inv_beta, c.one);
+            const __m256 peak_dist = _mm256_and_ps(_mm256_fmsub_ps(c.two, r, c.one_plus_beta), c.abs_mask);
+            const __m256 attraction = _mm256_mul_ps(a, _mm256_fnmadd_ps(peak_dist, c.inv_one_minus_beta, c.one));
+            const __m256 is_repulsion = _mm256_cmp_ps(r, c.beta, _CMP_LT_OQ);
+            const __m256 is_attraction = _mm256_and_ps(
+                _mm256_cmp_ps(r, c.beta, _CMP_GT_OQ),
+                _mm256_cmp_ps(r, c.one, _CMP_LT_OQ)
+            );
+            __m256 force_magnitude = _mm256_blendv_ps(_mm256_and_ps(attraction, is_attraction), repulsion, is_repulsion);
+            force_magnitude = _mm256_and_ps(force_magnitude, in_range);
+
+            const __m256 scale = _mm256_div_ps(_mm256_mul_ps(force_magnitude, c.range), dist);
+            acc_x = _mm256_fmadd_ps(scale, diff_x, acc_x);
+            acc_y = _mm256_fmadd_ps(scale, diff_y, acc_y);
+        }
+
+        __attribute__((target("avx2,fma")))
+        inline float horizontal_sum_avx2(__m256 v)
+        {
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            sum = _mm_hadd_ps(sum, sum);
+            sum = _mm_hadd_ps(sum, sum);
+            return _mm_cvtss_f32(sum);
+        }
+
+        template<bool CONTIGUOUS, bool TABLE>
+        __attribute__((target("avx2,fma")))
+        void pair_force_avx2(
+            const PairForceParams & params,
+            const float * nx,
+            const float * ny,
+            const std::uint8_t * ntype,
+            std::size_t begin,
+            const std::uint32_t * indices,
+            std::size_t n,
+            float x,
+            float y,
+            float & fx,
+            float & fy
+        )
+        {
+            const Avx2Constants c(params, x, y);
+            __m256 acc_x = _mm256_setzero_ps();
+            __m256 acc_y = _mm256_setzero_ps();
+
+            std::size_t k = 0;
+            for(; k + 8 <= n; k += 8)
+            {
+                if constexpr(CONTIGUOUS)
+                {
+                    const auto j = begin + k;
+                    const __m128i types8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(ntype + j));
+                    pair_force_block_avx2<TABLE>(c, params,
+                        _mm256_loadu_ps(nx + j), _mm256_loadu_ps(ny + j), _mm256_cvtepu8_epi32(types8),
+                        acc_x, acc_y
+                    );
+                }
+                else
+                {
+                    const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + k));
+                    alignas(32) std::int32_t types[8];
+                    for(int l = 0; l < 8; ++l)
+                    {
+                        types[l] = ntype[indices[k + l]];
+                    }
+                    pair_force_block_avx2<TABLE>(c, params,
+                        _mm256_i32gather_ps(nx, index, 4), _mm256_i32gather_ps(ny, index, 4),
+                        _mm256_load_si256(reinterpret_cast<const __m256i*>(types)),
+                        acc_x, acc_y
+                    );
+                }
+            }
+            fx += horizontal_sum_avx2(acc_x);
+            fy += horizontal_sum_avx2(acc_y);
+
+            pair_force_scalar<CONTIGUOUS, TABLE>(params, nx, ny, ntype, begin + k, indices + k, n - k, x, y, fx, fy);
+        }
+
+        struct Avx512Constants
+        {
+            __attribute__((target("avx512f,avx2,fma")))
+            Avx512Constants(const PairForceParams & params, float x, float y)
+            :   x(_mm512_set1_ps(x)),
+                y(_mm512_set1_ps(y)),
+                shape_x(_mm512_set1_ps(params.shape_x)),
+                shape_y(_mm512_set1_ps(params.shape_y)),
+                half_x(_mm512_set1_ps(params.shape_x / 2.0f)),
+                half_y(_mm512_set1_ps(params.shape_y / 2.0f)),
+                neg_half_x(_mm512_set1_ps(-params.shape_x / 2.0f)),
+                neg_half_y(_mm512_set1_ps(-params.shape_y / 2.0f)),
+                range(_mm512_set1_ps(params.range)),
+                range_sq(_mm512_set1_ps(params.range_sq)),
+                beta(_mm512_set1_ps(params.beta)),
+                inv_beta(_mm512_set1_ps(1.0f / params.beta)),
+                inv_one_minus_beta(_mm512_set1_ps(1.0f / (1.0f - params.beta))),
+                one_plus_beta(_mm512_set1_ps(1.0f + params.beta)),
+                one(_mm512_set1_ps(1.0f)),
+                two(_mm512_set1_ps(2.0f)),
+                eps(_mm512_set1_ps(1e-6f)),
+                stride(_mm512_set1_epi32(params.strength_stride)),
+                table_scale(_mm512_set1_ps(params.table_scale)),
+                table_max(_mm512_set1_ps(float(params.table_stride - 2))),
+                table_stride(_mm512_set1_epi32(params.table_stride))
+            {
+            }
+            __m512 x, y, shape_x, shape_y, half_x, half_y, neg_half_x, neg_half_y;
+            __m512 range, range_sq, beta, inv_beta, inv_one_minus_beta, one_plus_beta, one, two, eps;
+            __m512i stride;
+            __m512 table_scale, table_max;
+            __m512i table_stride;
+        };
+
+        // force of 16 neighbors at (nx, ny) with types `types`
+        template<bool TABLE>
+        __attribute__((target("avx512f,avx2,fma")))
+        inline void pair_force_block_avx512(
+            const Avx512Constants & c,
+            const PairForceParams & params,
+            __m512 nx,
+            __m512 ny,
+            __m512i types,
+            __m512 & acc_x,
+            __m512 & acc_y
+        )
+        {
+            __m512 diff_x = _mm512_sub_ps(nx, c.x);
+            __m512 diff_y = _mm512_sub_ps(ny, c.y);
+
+            // minimum image without branches
+            const __mmask16 above_x = _mm512_cmp_ps_mask(diff_x, c.half_x, _CMP_GT_OQ);
+            const __mmask16 below_x = _mm512_cmp_ps_mask(diff_x, c.neg_half_x, _CMP_LT_OQ);
+            const __mmask16 above_y = _mm512_cmp_ps_mask(diff_y, c.half_y, _CMP_GT_OQ);
+            const __mmask16 below_y = _mm512_cmp_ps_mask(diff_y, c.neg_half_y, _CMP_LT_OQ);
+            diff_x = _mm512_mask_sub_ps(diff_x, above_x, diff_x, c.shape_x);
+            diff_x = _mm512_mask_add_ps(diff_x, below_x, diff_x, c.shape_x);
+            diff_y = _mm512_mask_sub_ps(diff_y, above_y, diff_y, c.shape_y);
+            diff_y = _mm512_mask_add_ps(diff_y, below_y, diff_y, c.shape_y);
+
+            const __m512 dist_sq = _mm512_fmadd_ps(diff_x, diff_x, _mm512_mul_ps(diff_y, diff_y));
+            const __mmask16 in_range = _mm512_cmp_ps_mask(dist_sq, c.range_sq, _CMP_LT_OQ);
+            if(in_range == 0)
+            {
+                return;
+            }
+
+            if constexpr(TABLE)
+            {
+                // interpolate the table, only lanes in range are gathered
+                const __m512 t = _mm512_min_ps(_mm512_mul_ps(dist_sq, c.table_scale), c.table_max);
+                const __m512i k = _mm512_cvttps_epi32(t);
+                const __m512 frac = _mm512_sub_ps(t, _mm512_cvtepi32_ps(k));
+                const __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(types, c.table_stride), k);
+                const __m512 zero = _mm512_setzero_ps();
+                const __m512 h0 = _mm512_mask_i32gather_ps(zero, in_range, index, params.table, 4);
+                const __m512 h1 = _mm512_mask_i32gather_ps(zero, in_range, index, params.table + 1, 4);
+                const __m512 h = _mm512_fmadd_ps(frac, _mm512_sub_ps(h1, h0), h0);
+                acc_x = _mm512_fmadd_ps(h, diff_x, acc_x);
+                acc_y = _mm512_fmadd_ps(h, diff_y, acc_y);
+                return;
+            }
+
+            const __m512 dist = _mm512_add_ps(_mm512_sqrt_ps(dist_sq), c.eps);
+            const __m512 r = _mm512_div_ps(dist, c.range);
+
+            // gather the interaction strengths for the neighbor types
+            const __m512 a = _mm512_i32gather_ps(_mm512_mullo_epi32(types, c.stride), params.strength, 4);
+
+            // branchless force curve
+            const __m512 repulsion = _mm512_fmsub_ps(r, c.inv_beta, c.one);
+            const __m512 peak_dist = _mm512_abs_ps(_mm512_fmsub_ps(c.two, r, c.one_plus_beta));
+            const __m512 attraction = _mm512_mul_ps(a, _mm512_fnmadd_ps(peak_dist, c.inv_one_minus_beta, c.one));
+            const __mmask16 is_repulsion = _mm512_cmp_ps_mask(r, c.beta, _CMP_LT_OQ);
+            const __mmask16 is_attraction = _mm512_cmp_ps_mask(r, c.beta, _CMP_GT_OQ) & _mm512_cmp_ps_mask(r, c.one, _CMP_LT_OQ);
+            __m512 force_magnitude = _mm512_maskz_mov_ps(is_attraction, attraction);
+            force_magnitude = _mm512_mask_mov_ps(force_magnitude, is_repulsion, repulsion);
+            force_magnitude = _mm512_maskz_mov_ps(in_range, force_magnitude);
+
+            const __m512 scale = _mm512_div_ps(_mm512_mul_ps(force_magnitude, c.range), dist);
+            acc_x = _mm512_fmadd_ps(scale, diff_x, acc_x);
+            acc_y = _mm512_fmadd_ps(scale, diff_y, acc_y);
+        }
+
+        template<bool CONTIGUOUS, bool TABLE>
+        __attribute__((target("avx512f,avx2,fma")))
+        void pair_force_avx512(
+            const PairForceParams & params,
+            const float * nx,
+            const float * ny,
+            const std::uint8_t * ntype,
+            std::size_t begin,
+            const std::uint32_t * indices,
+            std::size_t n,
+            float x,
+            float y,
+            float & fx,
+            float & fy
+        )
+        {
+            const Avx512Constants c(params, x, y);
+            __m512 acc_x = _mm512_setzero_ps();
+            __m512 acc_y = _mm512_setzero_ps();
+
+            std::size_t k = 0;
+            for(; k + 16 <= n; k += 16)
+            {
+                if constexpr(CONTIGUOUS)
+                {
+                    const auto j = begin + k;
+                    const __m128i types8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ntype + j));
+                    pair_force_block_avx512<TABLE>(c, params,
+                        _mm512_loadu_ps(nx + j), _mm512_loadu_ps(ny + j), _mm512_cvtepu8_epi32(types8),
+                        acc_x, acc_y
+                    );
+                }
+                else
+                {
+                    const __m512i index = _mm512_loadu_si512(indices + k);
+                    alignas(64) std::int32_t types[16];
+                    for(int l = 0; l < 16; ++l)
+                    {
+                        types[l] = ntype[indices[k + l]];
+                    }
+                    pair_force_block_avx512<TABLE>(c, params,
+                        _mm512_i32gather_ps(index, nx, 4), _mm512_i32gather_ps(index, ny, 4),
+                        _mm512_load_si512(types),
+                        acc_x, acc_y
+                    );
+                }
+            }
+            fx += _mm512_reduce_add_ps(acc_x);
+            fy += _mm512_reduce_add_ps(acc_y);
+
+            pair_force_avx2<CONTIGUOUS, TABLE>(params, nx, ny, ntype, begin + k, indices + k, n - k, x, y, fx, fy);
+        }
+
+        #endif
+
+        // entry points with the public kernel signatures
+        void pair_force_range_scalar(const PairForceParams & params, const float * nx, const float * ny, const std::uint8_t * ntype,
+            std::size_t begin, std::size_t end, float x, float y, float & fx, float & fy)
+        {
+            if(params.table)
+                pair_force_scalar<true, true>(params, nx, ny, ntype, begin, nullptr, end - begin, x, y, fx, fy);
+            else
+                pair_force_scalar<true, false>(params, nx, ny, ntype, begin, nullptr, end - begin, x, y, fx, fy);
+        }
+        void pair_force_indexed_scalar(const PairForceParams & params, const float * nx, const float * ny, const std::uint8_t * ntype,
+            const std::uint32_t * indices, std::size_t n, float x, float y, float & fx, float & fy)
+        {
+            if(params.table)
+                pair_force_scalar<false, true>(params, nx, ny, ntype, 0, indices, n, x, y, fx, fy);
+            else
+                pair_force_scalar<false, false>(params, nx, ny, ntype, 0, indices, n, x, y, fx, fy);
+        }
+
+        #ifdef DTKS_X86_DISPATCH
+        __attribute__((target("avx2,fma")))
+        void pair_force_range_avx2(const PairForceParams & params, const float * nx, const float * ny, const std::uint8_t * ntype,
+            std::size_t begin, std::size_t end, float x, float y, float & fx, float & fy)
+        {
+            if(params.table)
+                pair_force_avx2<true, true>(params, nx, ny, ntype, begin, nullptr, end - begin, x, y, fx, fy);
+            else
+                pair_force_avx2<true, false>(params, nx, ny, ntype, begin, nullptr, end - begin, x, y, fx, fy);
+        }
+        __attribute__((target("avx2,fma")))
+        void pair_force_indexed_avx2(const PairForceParams & params, const float * nx, const float * ny, const std::uint8_t * ntype,
+            const std::uint32_t * indices, std::size_t n, float x, float y, float & fx, float & fy)
+        {
+            if(params.table)
+                pair_force_avx2<false, true>(params, nx, ny, ntype, 0, indices, n, x, y, fx, fy);
+            else
+                pair_force_avx2<false, false>(params, nx, ny, ntype, 0, indices, n, x, y, fx, fy);
+        }
+        __attribute__((target("avx512f,avx2,fma")))
+        void pair_force_range_avx512(const PairForceParams & params, const float * nx, const float * ny, const std::uint8_t * ntype,
+            std::size_t begin, std::size_t end, float x, float y, float & fx, float & fy)
+        {
+            if(params.table)
+                pair_force_avx512<true, true>(params, nx, ny, ntype, begin, nullptr, end - begin, x, y, fx, fy);
+            else
+                pair_force_avx512<true, false>(params, nx, ny, ntype, begin, nullptr, end - begin, x, y, fx, fy);
+        }
+        __attribute__((target("avx512f,avx2,fma")))
+        void pair_force_indexed_avx512(const PairForceParams & params, const float * nx, const float * ny, const std::uint8_t * ntype,
+            const std::uint32_t * indices, std::size_t n, float x, float y, float & fx, float & fy)
+        {
+            if(params.table)
+                pair_force_avx512<false, true>(params, nx, ny, ntype, 0, indices, n, x, y, fx, fy);
+            else
+                pair_force_avx512<false, false>(params, nx, ny, ntype, 0, indices, n, x, y, fx, fy);
+        }
+        #endif
+    }
+
+    SimdLevel detect_simd_level()
+    {
+        #ifdef DTKS_X86_DISPATCH
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return SimdLevel::avx512;
+        }
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return SimdLevel::avx2;
+        }
+        #endif
+        return SimdLevel::none;
+    }
+
+    SimdLevel resolve_simd_level(SimdLevel requested)
+    {
+        const auto supported = detect_simd_level();
+        if(requested == SimdLevel::automatic || static_cast<int>(requested) > static_cast<int>(supported))
+        {
+            return supported;
+        }
+        return requested;
+    }
+
+    const char * simd_level_name(SimdLevel level)
+    {
+        switch(level)
+        {
+            case SimdLevel::none:      return "none";
+            case SimdLevel::avx2:      return "avx2";
+            case SimdLevel::avx512:    return "avx512";
+            case SimdLevel::automatic: return "automatic";
+        }
+        return "unknown";
+    }
+
+    PairForceKernel pair_force_kernel(SimdLevel level)
+    {
+        switch(resolve_simd_level(level))
+        {
+            #ifdef DTKS_X86_DISPATCH
+            case SimdLevel::avx512: return &pair_force_range_avx512;
+            case SimdLevel::avx2:   return &pair_force_range_avx2;
+            #endif
+            default:                return &pair_force_range_scalar;
+        }
+    }
+
+    PairForceKernelIndexed pair_force_kernel_indexed(SimdLevel level)
+    {
+        switch(resolve_simd_level(level))
+        {
+            #ifdef DTKS_X86_DISPATCH
+            case SimdLevel::avx512: return &pair_force_indexed_avx512;
+            case SimdLevel::avx2:   return &pair_force_indexed_avx2;
+            #endif
+            default:                return &pair_force_indexed_scalar;
+        }
+    }
+
+} // namespace dtks
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace dtks{
+
+    // instruction set used by the particle-life pair force kernel
+    enum class SimdLevel
+    {
+        none,       // portable scalar code
+        avx2,       // 8 neighbors per iteration
+        avx512,     // 16 neighbors per iteration
+        automatic   // best level supported by the cpu we are running on
+    };
+
+    // everything the pair force kernel needs besides the particle arrays
+    struct PairForceParams
+    {
+        float range;
+        float range_sq;
+        float shape_x;
+        float shape_y;
+        float beta = 0.3f;
+
+        // interaction strength of the current particle with a neighbor of
+        // type t is strength[t * strength_stride]
+        const float * strength;
+        int strength_stride;
+
+        // optional tabulated forces (see ForceTable) for the current particle's type:
+        // the samples of a neighbor of type t start at table[t * table_stride] and
+        // table_scale maps the squared distance to a sample index.
+        // nullptr evaluates force_curve instead
+        const float * table = nullptr;
+        int table_stride = 0;
+        float table_scale = 0.0f;
+    };
+
+    // adds the force acting on the particle at (x, y) from the neighbors
+    // [begin, end) of the structure-of-arrays (nx, ny, ntype) to (fx, fy).
+    // A neighbor at exactly (x, y), like the particle itself, contributes nothing.
+    using PairForceKernel = void (*)(
+        const PairForceParams & params,
+        const float * nx,
+        const float * ny,
+        const std::uint8_t * ntype,
+        std::size_t begin,
+        std::size_t end,
+        float x,
+        float y,
+        float & fx,
+        float & fy
+    );
+
+    // same as PairForceKernel for the neighbors indices[0] ... indices[n - 1]
+    using PairForceKernelIndexed = void (*)(
+        const PairForceParams & params,
+        const float * nx,
+        const float * ny,
+        const std::uint8_t * ntype,
+        const std::uint32_t * indices,
+        std::size_t n,
+        float x,
+        float y,
+        float & fx,
+        float & fy
+    );
+
+    // highest level supported by the cpu (never returns automatic)
+    SimdLevel detect_simd_level();
+
+    // resolves automatic and falls back to the best supported level
+    // if the requested one is not available on this cpu
+    SimdLevel resolve_simd_level(SimdLevel requested);
+
+    const char * simd_level_name(SimdLevel level);
+
+    PairForceKernel pair_force_kernel(SimdLevel level);
+    PairForceKernelIndexed pair_force_kernel_indexed(SimdLevel level);
+
+    // branchless form of the particle-life force curve
+    inline float force_curve(float r, float a, float beta)
+    {
+        const float repulsion = r / beta - 1.0f;
+        const float attraction = a * (1.0f - std::abs(2.0f * r - 1.0f - beta) / (1.0f - beta));
+        const float outer = (beta < r && r < 1.0f) ? attraction : 0.0f;
+        return r < beta ? repulsion : outer;
+    }
+
+} // namespace dtks
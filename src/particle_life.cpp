@@ -1,6 +1,8 @@
 #include "particle_life.hpp"
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
 namespace dtks{
 
 
@@ -35,49 +37,37 @@ namespace dtks{
     
     ParticleSimulation::ParticleSimulation(const ParticleLifeParameters& params)
     :   params_(params),
-        particle_in_grid_cell_({
-            int(std::ceil(float(params.shape[0]) / params.max_range)),
-            int(std::ceil(float(params.shape[1]) / params.max_range))
-        }
-        ), 
+        cell_list_(
+            {float(params.shape[0]), float(params.shape[1])},
+            float(params.max_range) + params.verlet_skin,
+            params.cell_subdivision
+        ),
         particles_(params.n_particle_types * params.n_particles_per_type),
-        generator_(params.seed)
+        generator_(params.seed),
+        thread_pool_(params.n_threads == 1 ? nullptr : std::make_unique<ThreadPool>(params.n_threads)),
+        gather_forces_(params.n_threads != 1 || params.simd_level != SimdLevel::none),
+        pair_force_kernel_(pair_force_kernel(params.simd_level)),
+        pair_force_kernel_indexed_(pair_force_kernel_indexed(params.simd_level))
     {
-
-        //  pre-reserve space in each grid cell
-        for(std::size_t i=0; i<particle_in_grid_cell_.size(); ++i)
-        {
-            particle_in_grid_cell_[i].reserve(100);
-        }
-
-        std::cout<<"shape of the grid: "<<particle_in_grid_cell_.shape()[0]<<" "<<particle_in_grid_cell_.shape()[1]<<"\n";
         max_range_sq_ = float(params.max_range * params.max_range);
-        std::size_t particle_index = 0;
         for(std::size_t i=0; i<params.n_particle_types; ++i)
         {
             for(std::size_t j=0; j<params.n_particles_per_type; ++j)
             {
-                auto & particle = particles_[i * params_.n_particles_per_type + j];
+                const auto index = i * params_.n_particles_per_type + j;
                 std::uniform_real_distribution<float> dist_x(0.0f, float(params_.shape[0]));
                 std::uniform_real_distribution<float> dist_y(0.0f, float(params_.shape[1]));
                 std::uniform_real_distribution<float> dist_vel(-1.0f, 1.0f);
-                particle.position = { dist_x(generator_), dist_y(generator_) };
-                particle.velocity = { 0,0 };
-                particle.type = static_cast<std::uint8_t>(i);
-                auto gi = grid_cell_index(particle.position);
-                auto gc = grid_cell(particle.position);
-                if(gi >= particle_in_grid_cell_.size())
-                {
-                    std::cout<<"position: "<<particle.position[0]<<" "<<particle.position[1]<<"\n";
-                    std::cout<<"grid cell: "<<gc[0]<<" "<<gc[1]<<"\n";
-
-                    std::cout<<"Error: grid cell index out of bounds: "<<gi<<" size: "<<particle_in_grid_cell_.size()<<"\n";
-                    throw std::runtime_error("Grid cell index out of bounds");
-                }
-                particle_in_grid_cell_[gi].push_back(particle_index);
-                ++particle_index;
+                particles_.x[index] = dist_x(generator_);
+                particles_.y[index] = dist_y(generator_);
+                particles_.vx[index] = 0.0f;
+                particles_.vy[index] = 0.0f;
+                particles_.type[index] = static_cast<std::uint8_t>(i);
+                particles_.id[index] = static_cast<std::uint32_t>(index);
             }
         }
+        sort_particles_by_cell();
+        set_interaction_strength(params_.interaction_strength);
 
         // if no colors are provided, generate some random ones
         if(params_.type_colors.size() < params_.n_particle_types)
@@ -94,126 +84,367 @@ namespace dtks{
         }
     }
 
+    SimdLevel ParticleSimulation::simd_level_used() const
+    {
+        return gather_forces_ ? resolve_simd_level(params_.simd_level) : SimdLevel::none;
+    }
+
+    void ParticleSimulation::set_interaction_strength(const Image2d<float> & interaction_strength)
+    {
+        const int n_types = params_.n_particle_types;
+        if(interaction_strength.shape()[0] != n_types || interaction_strength.shape()[1] != n_types)
+        {
+            std::stringstream ss;
+            ss << "interaction_strength must be " << n_types << " x " << n_types << " (n_particle_types), got "
+               << interaction_strength.shape()[0] << " x " << interaction_strength.shape()[1];
+            throw std::invalid_argument(ss.str());
+        }
+        params_.interaction_strength = interaction_strength;
+        if(params_.force_table_size == 0 && !params_.force_curve)
+        {
+            force_table_ = ForceTable();
+            return;
+        }
+        const std::size_t n_samples = params_.force_table_size > 0 ? params_.force_table_size : 1024;
+        if(params_.force_curve)
+        {
+            force_table_ = ForceTable(params_.interaction_strength, float(params_.max_range), n_samples, params_.force_curve);
+        }
+        else
+        {
+            force_table_ = ForceTable(params_.interaction_strength, float(params_.max_range), n_samples, [](float r, float a){ return distance(r, a); });
+        }
+    }
+
     // step function
     void ParticleSimulation::step()
     {
+        accumulate_forces();
+        integrate();
 
-        auto wrap = [](float coord, int max_coord)
+        // with verlet lists the particles are only re-sorted when the list is rebuilt
+        if(params_.verlet_skin <= 0.0f)
         {
-            while(coord < 0.0f)  coord += float(max_coord);
-            while(coord >= float(max_coord))  coord -= float(max_coord);
-            return coord;
-        };
+            sort_particles_by_cell();
+        }
+    }
 
-        // update positions
-        for(std::size_t particle_index=0; particle_index<particles_.size(); ++particle_index)
+    std::array<std::vector<float>, 2> ParticleSimulation::compute_forces()
+    {
+        accumulate_forces();
+        std::array<std::vector<float>, 2> forces = {particles_.fx, particles_.fy};
+        std::fill(particles_.fx.begin(), particles_.fx.end(), 0.0f);
+        std::fill(particles_.fy.begin(), particles_.fy.end(), 0.0f);
+        return forces;
+    }
+
+    std::array<std::vector<float>, 2> ParticleSimulation::brute_force_forces() const
+    {
+        const float range = float(params_.max_range);
+        const float shape_x = float(params_.shape[0]);
+        const float shape_y = float(params_.shape[1]);
+        const auto n = particles_.size();
+
+        std::array<std::vector<float>, 2> forces = {std::vector<float>(n, 0.0f), std::vector<float>(n, 0.0f)};
+        for(std::size_t i = 0; i < n; ++i)
         {
-            auto & particle = particles_[particle_index];
-        
-            std::size_t n_neighbors = 0;
+            for(std::size_t j = 0; j < n; ++j)
+            {
+                if(i == j)
+                {
+                    continue;
+                }
+                float diff_x = particles_.x[j] - particles_.x[i];
+                float diff_y = particles_.y[j] - particles_.y[i];
+                if(diff_x > shape_x / 2.0f)
+                    diff_x -= shape_x;
+                else if(diff_x < -shape_x / 2.0f)
+                    diff_x += shape_x;
+                if(diff_y > shape_y / 2.0f)
+                    diff_y -= shape_y;
+                else if(diff_y < -shape_y / 2.0f)
+                    diff_y += shape_y;
+
+                const float dist_sq = diff_x*diff_x + diff_y*diff_y;
+                if(dist_sq < max_range_sq_)
+                {
+                    const float dist = std::sqrt(dist_sq) + 1e-6f;
+                    const float strength = params_.interaction_strength(particles_.type[i], particles_.type[j]);
+                    const float force_magnitude = params_.force_curve ? params_.force_curve(dist / range, strength) : distance(dist / range, strength);
+                    forces[0][i] += force_magnitude * (range * (diff_x / dist));
+                    forces[1][i] += force_magnitude * (range * (diff_y / dist));
+                }
+            }
+        }
+        return forces;
+    }
 
+    void ParticleSimulation::accumulate_forces()
+    {
+        const bool use_verlet_list = params_.verlet_skin > 0.0f;
+        if(use_verlet_list && verlet_list_.needs_rebuild(
+            particles_.x.data(), particles_.y.data(), particles_.size(),
+            params_.verlet_skin, {float(params_.shape[0]), float(params_.shape[1])},
+            [&](std::size_t n, auto && f){ for_each_chunk(n, f); }))
+        {
+            sort_particles_by_cell();
+            build_verlet_list();
+        }
 
+        if(gather_forces_)
+        {
+            accumulate_forces_gather();
+        }
+        else
+        {
+            accumulate_forces_serial();
+        }
+    }
+
+    void ParticleSimulation::build_verlet_list()
+    {
+        verlet_list_.build(
+            cell_list_,
+            particles_.x.data(), particles_.y.data(), particles_.size(),
+            float(params_.max_range) + params_.verlet_skin,
+            {float(params_.shape[0]), float(params_.shape[1])},
+            !gather_forces_,
+            [&](std::size_t n, auto && f){ for_each_chunk(n, f); }
+        );
+        ++n_verlet_list_builds_;
+    }
 
-            const auto grid_coord = this->grid_cell(particle.position);
+    void ParticleSimulation::accumulate_forces_serial()
+    {
+        const float * const px = particles_.x.data();
+        const float * const py = particles_.y.data();
+        float * const pfx = particles_.fx.data();
+        float * const pfy = particles_.fy.data();
+        const std::uint8_t * const ptype = particles_.type.data();
+
+        const float range = float(params_.max_range);
+        const float shape_x = float(params_.shape[0]);
+        const float shape_y = float(params_.shape[1]);
+        const bool use_verlet_list = params_.verlet_skin > 0.0f;
+        const bool use_force_table = !force_table_.empty();
 
-            for(auto yy=-1; yy<=1; ++yy)
+        // update positions
+        for(std::size_t particle_index=0; particle_index<particles_.size(); ++particle_index)
+        {
+            const float x = px[particle_index];
+            const float y = py[particle_index];
+            const auto type = ptype[particle_index];
+            float force_x = pfx[particle_index];
+            float force_y = pfy[particle_index];
+
+            // adds the force of the pair to both particles
+            auto interact = [&](std::size_t neighbor_index)
             {
-                for(auto xx=-1; xx<=1; ++xx)
+                float diff_x = px[neighbor_index] - x;
+                float diff_y = py[neighbor_index] - y;
+                // apply periodic boundary conditions
+                if(diff_x > shape_x / 2.0f)
+                    diff_x -= shape_x;
+                else if(diff_x < -shape_x / 2.0f)
+                    diff_x += shape_x;
+                if(diff_y > shape_y / 2.0f)
+                    diff_y -= shape_y;
+                else if(diff_y < -shape_y / 2.0f)
+                    diff_y += shape_y;
+
+                const float dist_sq = diff_x*diff_x + diff_y*diff_y;
+                if(use_force_table && dist_sq < max_range_sq_)
                 {
+                    const auto neighbor_type = ptype[neighbor_index];
+                    const float h_ab = force_table_(type, neighbor_type, dist_sq);
+                    const float h_ba = force_table_(neighbor_type, type, dist_sq);
+                    force_x += h_ab * diff_x;
+                    force_y += h_ab * diff_y;
+                    pfx[neighbor_index] -= h_ba * diff_x;
+                    pfy[neighbor_index] -= h_ba * diff_y;
+                }
+                else if(dist_sq < max_range_sq_)
+                {
+                    const auto neighbor_type = ptype[neighbor_index];
+                    const float dist = std::sqrt(dist_sq) + 1e-6f;
+                    float interaction_strength_ab = params_.interaction_strength(type, neighbor_type);
+                    float interaction_strength_ba = params_.interaction_strength(neighbor_type, type);
+                    const float unit_diff_times_range_x = range * (diff_x / dist);
+                    const float unit_diff_times_range_y = range * (diff_y / dist);
+
+                    const float rdist = dist / range;
+
+                    float force_magnitude_ab = distance(rdist, interaction_strength_ab);
+                    force_x += force_magnitude_ab * unit_diff_times_range_x;
+                    force_y += force_magnitude_ab * unit_diff_times_range_y;
+
+                    float force_magnitude_ba = distance(rdist, interaction_strength_ba);
+                    pfx[neighbor_index] -= force_magnitude_ba * unit_diff_times_range_x;
+                    pfy[neighbor_index] -= force_magnitude_ba * unit_diff_times_range_y;
+                }
+            };
 
-                    auto neighbor_cell_x = wrap(grid_coord[0] + xx, particle_in_grid_cell_.shape()[0]);
-                    auto neighbor_cell_y = wrap(grid_coord[1] + yy, particle_in_grid_cell_.shape()[1]);
-                    auto & neighbor_cell = particle_in_grid_cell_[neighbor_cell_y * particle_in_grid_cell_.shape()[0] + neighbor_cell_x];
-
-                    for(auto neighbor_index : neighbor_cell)
+            if(use_verlet_list)
+            {
+                // the list only holds neighbors with a smaller index
+                const auto & neighbors = verlet_list_.indices();
+                for(auto k = verlet_list_.begin(particle_index); k < verlet_list_.end(particle_index); ++k)
+                {
+                    interact(neighbors[k]);
+                }
+            }
+            else
+            {
+                cell_list_.for_each_neighbor_cell(cell_list_.cell_index(x, y), [&](std::size_t neighbor_cell)
+                {
+                    // particles are sorted by cell, only visit neighbors with a smaller index
+                    const auto neighbor_begin = cell_list_.cell_begin(neighbor_cell);
+                    const auto neighbor_end = std::min(cell_list_.cell_end(neighbor_cell), particle_index);
+                    for(auto neighbor_index = neighbor_begin; neighbor_index < neighbor_end; ++neighbor_index)
                     {
-                        if(neighbor_index > particle_index)
-                        {
-                            continue;
-                        }
-                        
-
-                        auto & neighbor_particle = particles_[neighbor_index];
-                        if(&neighbor_particle != &particle)
-                        {
-                            TinyVector<float, 2> diff = neighbor_particle.position - particle.position;
-                            // apply periodic boundary conditions
-                            for(std::size_t d=0; d<2; ++d)
-                            {
-                                if(diff[d] > float(params_.shape[d]) / 2.0f)
-                                    diff[d] -= float(params_.shape[d]);
-                                else if(diff[d] < -float(params_.shape[d]) / 2.0f)
-                                    diff[d] += float(params_.shape[d]);
-                            }
-                            const float dist_sq = diff[0]*diff[0] + diff[1]*diff[1];
-                            if(dist_sq < max_range_sq_)
-                            {
-                                n_neighbors++;
-                                const float dist = std::sqrt(dist_sq) + 1e-6f;
-                                float interaction_strength_ab = params_.interaction_strength(particle.type,neighbor_particle.type);
-                                float interaction_strength_ba = params_.interaction_strength(neighbor_particle.type, particle.type);
-                                const auto unit_diff_times_range =  params_.max_range  * (diff / dist); 
-                                
-                                const float rdist = dist / float(params_.max_range);
-                               
-                                float force_magnitude_ab = distance(rdist, interaction_strength_ab);
-                                particle.force[0] += force_magnitude_ab * unit_diff_times_range[0];
-                                particle.force[1] += force_magnitude_ab * unit_diff_times_range[1];
-
-                                float force_magnitude_ba = distance(rdist, interaction_strength_ba);
-                                neighbor_particle.force[0] -= force_magnitude_ba * unit_diff_times_range[0];
-                                neighbor_particle.force[1] -= force_magnitude_ba * unit_diff_times_range[1];
-
-                            }
-                        }
+                        interact(neighbor_index);
                     }
-                }
+                });
             }
+            pfx[particle_index] = force_x;
+            pfy[particle_index] = force_y;
         }
-        // clear grid cells
-        for(std::size_t i=0; i<particle_in_grid_cell_.size(); ++i)
+    }
+
+    void ParticleSimulation::accumulate_forces_gather()
+    {
+        const float * const px = particles_.x.data();
+        const float * const py = particles_.y.data();
+        float * const pfx = particles_.fx.data();
+        float * const pfy = particles_.fy.data();
+        const std::uint8_t * const ptype = particles_.type.data();
+
+        PairForceParams pair_params;
+        pair_params.range = float(params_.max_range);
+        pair_params.range_sq = max_range_sq_;
+        pair_params.shape_x = float(params_.shape[0]);
+        pair_params.shape_y = float(params_.shape[1]);
+        pair_params.strength = nullptr;
+        pair_params.strength_stride = params_.interaction_strength.shape()[0];
+        const float * const strength = params_.interaction_strength.data();
+        pair_params.table_stride = int(force_table_.stride());
+        pair_params.table_scale = force_table_.scale();
+
+        // every particle sums the forces acting on itself over all its neighbors,
+        // so each thread only writes the forces of the particles it owns.
+        // A pair is evaluated twice, but there is no race and no reduction, and
+        // the summation order does not depend on the number of threads.
+        if(params_.verlet_skin > 0.0f)
         {
-            particle_in_grid_cell_[i].clear();
+            const auto & neighbors = verlet_list_.indices();
+            for_each_chunk(particles_.size(), [&](std::size_t begin, std::size_t end)
+            {
+                auto kernel_params = pair_params;
+                for(std::size_t particle_index = begin; particle_index < end; ++particle_index)
+                {
+                    float force_x = 0.0f;
+                    float force_y = 0.0f;
+                    kernel_params.strength = strength + ptype[particle_index];
+                    if(!force_table_.empty())
+                    {
+                        kernel_params.table = force_table_.row(ptype[particle_index]);
+                    }
+                    const auto list_begin = verlet_list_.begin(particle_index);
+                    pair_force_kernel_indexed_(
+                        kernel_params, px, py, ptype,
+                        neighbors.data() + list_begin, verlet_list_.end(particle_index) - list_begin,
+                        px[particle_index], py[particle_index],
+                        force_x, force_y
+                    );
+                    pfx[particle_index] = force_x;
+                    pfy[particle_index] = force_y;
+                }
+            });
+            return;
         }
-        // apply forces and update positions
-        for(auto & particle : particles_)
-        {   
-            auto dt = 0.02f;
-            auto friction = 0.5f;
-            particle.velocity[0]  = particle.velocity[0] * friction + particle.force[0] * dt;
-            particle.velocity[1]  = particle.velocity[1] * friction + particle.force[1] * dt;
 
-            particle.position[0] += particle.velocity[0] * dt;
-            particle.position[1] += particle.velocity[1] * dt;
+        for_each_chunk(cell_list_.n_cells(), [&](std::size_t cell_begin, std::size_t cell_end)
+        {
+            auto kernel_params = pair_params;
+            for(std::size_t cell = cell_begin; cell < cell_end; ++cell)
+            {
+                for(auto particle_index = cell_list_.cell_begin(cell); particle_index < cell_list_.cell_end(cell); ++particle_index)
+                {
+                    float force_x = 0.0f;
+                    float force_y = 0.0f;
+                    kernel_params.strength = strength + ptype[particle_index];
+                    if(!force_table_.empty())
+                    {
+                        kernel_params.table = force_table_.row(ptype[particle_index]);
+                    }
+                    cell_list_.for_each_neighbor_cell(cell, [&](std::size_t neighbor_cell)
+                    {
+                        pair_force_kernel_(
+                            kernel_params, px, py, ptype,
+                            cell_list_.cell_begin(neighbor_cell), cell_list_.cell_end(neighbor_cell),
+                            px[particle_index], py[particle_index],
+                            force_x, force_y
+                        );
+                    });
+                    pfx[particle_index] = force_x;
+                    pfy[particle_index] = force_y;
+                }
+            }
+        });
+    }
+
+    void ParticleSimulation::integrate()
+    {
+        auto wrap = [](float coord, int max_coord)
+        {
+            while(coord < 0.0f)  coord += float(max_coord);
+            while(coord >= float(max_coord))  coord -= float(max_coord);
+            return coord;
+        };
 
+        float * const px = particles_.x.data();
+        float * const py = particles_.y.data();
+        float * const pvx = particles_.vx.data();
+        float * const pvy = particles_.vy.data();
+        float * const pfx = particles_.fx.data();
+        float * const pfy = particles_.fy.data();
 
-            //reset force
-            particle.force = {0.0f, 0.0f};
+        const float shape_x = float(params_.shape[0]);
+        const float shape_y = float(params_.shape[1]);
 
-            // apply periodic boundary conditions
-            for(std::size_t d=0; d<2; ++d)
-            {
-                particle.position[d] = wrap(particle.position[d], params_.shape[d]);    
-            }
-            // assert position is within bounds
-            for(std::size_t d=0; d<2; ++d)
+        // apply forces and update positions
+        const auto dt = 0.02f;
+        const auto friction = 0.5f;
+        for_each_chunk(particles_.size(), [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i=begin; i<end; ++i)
             {
-                if(particle.position[d] < 0.0f || particle.position[d] >= float(params_.shape[d]))
+                pvx[i] = pvx[i] * friction + pfx[i] * dt;
+                pvy[i] = pvy[i] * friction + pfy[i] * dt;
+
+                px[i] = wrap(px[i] + pvx[i] * dt, params_.shape[0]);
+                py[i] = wrap(py[i] + pvy[i] * dt, params_.shape[1]);
+
+                //reset force
+                pfx[i] = 0.0f;
+                pfy[i] = 0.0f;
+
+                // assert position is within bounds
+                if(px[i] < 0.0f || px[i] >= shape_x || py[i] < 0.0f || py[i] >= shape_y)
                 {
-                    std::cout<<"particle position out of bounds: "<<particle.position[0]<<" "<<particle.position[1]<<" shape: "<<params_.shape[0]<<" "<<params_.shape[1]<<"\n";
-                    throw std::runtime_error("Particle position out of bounds after wrapping"); 
+                    std::cout<<"particle position out of bounds: "<<px[i]<<" "<<py[i]<<" shape: "<<params_.shape[0]<<" "<<params_.shape[1]<<"\n";
+                    throw std::runtime_error("Particle position out of bounds after wrapping");
                 }
             }
-        }
+        });
+    }
 
 
-        // re-insert into grid cells
-        for(std::size_t i=0; i<particles_.size(); ++i)
-        {
-            const auto grid_coord = this->grid_cell(particles_[i].position);
-            //std::cout<<"grid coord: "<<grid_coord[0]<<" "<<grid_coord[1]<<" shape: "<<particle_in_grid_cell_.shape()[0]<<" "<<particle_in_grid_cell_.shape()[1]<<"\n";
-            particle_in_grid_cell_[grid_coord[1] * particle_in_grid_cell_.shape()[0] + grid_coord[0]].push_back(i);
-        }
+    void ParticleSimulation::sort_particles_by_cell()
+    {
+        cell_list_.build(particles_.x.data(), particles_.y.data(), particles_.size());
+        particles_.gather(cell_list_.order(), sorted_particles_);
+        particles_.copy_from(sorted_particles_);
     }
 
 
@@ -1,8 +1,16 @@
 
 #pragma once
 #include <vector>
+#include <algorithm>
 #include <random>
+#include <memory>
+#include <functional>
 #include "image.hpp"
+#include "cell_list.hpp"
+#include "verlet_list.hpp"
+#include "thread_pool.hpp"
+#include "particle_kernels.hpp"
+#include "force_table.hpp"
 
 namespace dtks{
     
@@ -12,6 +20,112 @@ namespace dtks{
         TinyVector<float, 2> force = {0.0f, 0.0f};
         std::uint8_t type;
     };
+
+    // structure-of-arrays storage for the particles.
+    // the hot loops in ParticleSimulation::step only touch the arrays they need,
+    // operator[] and the iterators gather a single Particle for drawing / inspection
+    struct ParticleArrays
+    {
+        class const_iterator
+        {
+            public:
+            using value_type = Particle;
+            using difference_type = std::ptrdiff_t;
+
+            const_iterator() = default;
+            const_iterator(const ParticleArrays* arrays, std::size_t index) : arrays_(arrays), index_(index) {}
+
+            Particle operator*() const { return (*arrays_)[index_]; }
+            const_iterator& operator++() { ++index_; return *this; }
+            const_iterator operator++(int) { auto tmp = *this; ++index_; return tmp; }
+            bool operator==(const const_iterator& other) const { return index_ == other.index_; }
+            bool operator!=(const const_iterator& other) const { return index_ != other.index_; }
+
+            private:
+            const ParticleArrays* arrays_ = nullptr;
+            std::size_t index_ = 0;
+        };
+
+        ParticleArrays() = default;
+        ParticleArrays(std::size_t n)
+        {
+            resize(n);
+        }
+
+        void resize(std::size_t n)
+        {
+            x.resize(n);
+            y.resize(n);
+            vx.resize(n);
+            vy.resize(n);
+            fx.resize(n, 0.0f);
+            fy.resize(n, 0.0f);
+            type.resize(n);
+            id.resize(n);
+        }
+
+        std::size_t size() const
+        {
+            return x.size();
+        }
+
+        // dst[k] = (*this)[order[k]] for all arrays
+        void gather(const std::vector<std::uint32_t>& order, ParticleArrays& dst) const
+        {
+            dst.resize(order.size());
+            for(std::size_t k = 0; k < order.size(); ++k)
+            {
+                const auto i = order[k];
+                dst.x[k] = x[i];
+                dst.y[k] = y[i];
+                dst.vx[k] = vx[i];
+                dst.vy[k] = vy[i];
+                dst.fx[k] = fx[i];
+                dst.fy[k] = fy[i];
+                dst.type[k] = type[i];
+                dst.id[k] = id[i];
+            }
+        }
+
+        // element wise copy into the existing buffers, so pointers into
+        // the arrays (e.g. numpy views) stay valid
+        void copy_from(const ParticleArrays& other)
+        {
+            resize(other.size());
+            std::copy(other.x.begin(), other.x.end(), x.begin());
+            std::copy(other.y.begin(), other.y.end(), y.begin());
+            std::copy(other.vx.begin(), other.vx.end(), vx.begin());
+            std::copy(other.vy.begin(), other.vy.end(), vy.begin());
+            std::copy(other.fx.begin(), other.fx.end(), fx.begin());
+            std::copy(other.fy.begin(), other.fy.end(), fy.begin());
+            std::copy(other.type.begin(), other.type.end(), type.begin());
+            std::copy(other.id.begin(), other.id.end(), id.begin());
+        }
+
+        Particle operator[](std::size_t i) const
+        {
+            return Particle{
+                TinyVector<float, 2>{x[i], y[i]},
+                TinyVector<float, 2>{vx[i], vy[i]},
+                TinyVector<float, 2>{fx[i], fy[i]},
+                type[i]
+            };
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size()); }
+
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> vx;
+        std::vector<float> vy;
+        std::vector<float> fx;
+        std::vector<float> fy;
+        std::vector<std::uint8_t> type;
+        // index of the particle at construction, the arrays are reordered by cell
+        // on every sort, id follows the particles through that
+        std::vector<std::uint32_t> id;
+    };
     
     struct ParticleLifeParameters
     {
@@ -20,6 +134,28 @@ namespace dtks{
         std::array<int, 2> shape = {1024, 1024} ;
         std::size_t max_range = 64;
         std::size_t seed = 42;
+        // threads used by step(). 1 runs the serial path which visits each pair once
+        // (newton's third law), any other value (0: all cores) computes each
+        // particle's force independently, which is race free and gives the same
+        // result for every thread count
+        std::size_t n_threads = 1;
+        // instruction set of the pair force kernel in the per-particle force path.
+        // automatic picks the best one at runtime. Anything but none also selects
+        // that path when n_threads is 1
+        SimdLevel simd_level = SimdLevel::none;
+        // > 0 enables verlet neighbor lists: each particle keeps the neighbors within
+        // max_range + verlet_skin, and the lists (and the cell sort) are only rebuilt
+        // once some particle moved more than verlet_skin / 2
+        float verlet_skin = 0.0f;
+        // grid cells are (max_range + verlet_skin) / cell_subdivision wide.
+        // 2 or 3 scan a disc shaped block of cells instead of 3x3 full size cells
+        int cell_subdivision = 1;
+        // > 0 tabulates the force curve of every type pair with this many samples
+        // (uniform in the squared distance, see ForceTable) instead of evaluating it per pair
+        std::size_t force_table_size = 0;
+        // optional custom force curve f(r, a), r = distance / max_range, a = interaction strength.
+        // It is always evaluated through the force table (1024 samples if force_table_size is 0)
+        std::function<float(float, float)> force_curve;
         std::vector<TinyVector<uint8_t, 3>> type_colors;
         dtks::Image2d<float> interaction_strength;
 
@@ -31,30 +167,62 @@ namespace dtks{
 
         ParticleLifeParameters params_;
         float max_range_sq_;
-        // for fast neighbor search, we divide the space into grid cells
-        Image2d<std::vector<std::size_t>> particle_in_grid_cell_;
-        std::vector<Particle> particles_;
+        // for fast neighbor search, we divide the space into grid cells.
+        // particles_ is kept sorted by grid cell, so the particles of one cell
+        // are the contiguous index range [cell_begin, cell_end).
+        // The sort copies back into the same buffers, pointers into particles_ stay valid
+        CellList cell_list_;
+        ParticleArrays particles_;
+        ParticleArrays sorted_particles_; // scratch buffer for the reordering
+        VerletList verlet_list_;
+        std::size_t n_verlet_list_builds_ = 0;
 
         // rand generator
         std::mt19937 generator_;
 
         void step();
 
+        // instruction set of the pair force kernel step() runs,
+        // none for the serial path
+        SimdLevel simd_level_used() const;
 
-        // helper
-        inline std::size_t grid_cell_index(const TinyVector<float, 2>& position)
-        {
-            int cell_x = static_cast<int>(position[0] / params_.max_range );
-            int cell_y = static_cast<int>(position[1] / params_.max_range );
-            return cell_y * particle_in_grid_cell_.shape()[0] + cell_x;
-        }
-        inline TinyVector<int, 2> grid_cell(const TinyVector<float, 2>& position)
+        // replaces params_.interaction_strength and rebuilds the force table.
+        // Throws std::invalid_argument unless it is n_particle_types x n_particle_types
+        void set_interaction_strength(const Image2d<float> & interaction_strength);
+
+        // forces acting on the particles in their current state (in particles_ order),
+        // computed with the configured neighbor search, without advancing the simulation
+        std::array<std::vector<float>, 2> compute_forces();
+        // the same, by testing all O(N^2) pairs
+        std::array<std::vector<float>, 2> brute_force_forces() const;
+
+        private:
+        void accumulate_forces();
+        void build_verlet_list();
+        void accumulate_forces_serial();
+        void accumulate_forces_gather();
+        void integrate();
+        void sort_particles_by_cell();
+
+        // f(begin, end) over [0, n), split across the thread pool if there is one
+        template<class F>
+        void for_each_chunk(std::size_t n, F && f)
         {
-            int cell_x = static_cast<int>(position[0] / params_.max_range );
-            int cell_y = static_cast<int>(position[1] / params_.max_range );
-            return TinyVector<int, 2>{cell_x, cell_y};
+            if(thread_pool_)
+            {
+                thread_pool_->parallel_for(0, n, std::forward<F>(f));
+            }
+            else
+            {
+                f(std::size_t(0), n);
+            }
         }
 
+        std::unique_ptr<ThreadPool> thread_pool_;
+        bool gather_forces_;
+        PairForceKernel pair_force_kernel_;
+        PairForceKernelIndexed pair_force_kernel_indexed_;
+        ForceTable force_table_;
     };
 
 
@@ -0,0 +1,319 @@
+#include "particle_life.hpp"
+#include "bench_args.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// headless benchmark for the particle-life neighbor search.
+// usage: particle_life_bench [n_particles_per_type] [n_steps]
+// For each cell subdivision it reports how many candidate pairs the
+// neighborhood traversal visits, how many of them are within max_range,
+// and the time per step.
+//
+// usage: particle_life_bench --check
+// compares the forces of all neighbor search configurations against the
+// O(N^2) reference on small, non-square and odd sized worlds, and the forces
+// of the force table (built-in and custom curve) against the O(N^2) forces of
+// the exact curve, returns 1 on mismatch.
+
+namespace
+{
+    dtks::ParticleLifeParameters make_parameters(std::size_t n_particles_per_type)
+    {
+        auto param = dtks::ParticleLifeParameters();
+        param.n_particle_types = 10;
+        param.n_particles_per_type = n_particles_per_type;
+
+        std::mt19937 generator(param.seed);
+        dtks::Image2d<float> interaction_strength({param.n_particle_types, param.n_particle_types}, 0.0f);
+        std::uniform_real_distribution<float> interaction_dist(-1,1);
+        for(std::size_t i=0; i<param.n_particle_types; ++i)
+        {
+            for(std::size_t j=0; j<param.n_particle_types; ++j)
+            {
+                interaction_strength(i, j) = interaction_dist(generator);
+            }
+        }
+        param.interaction_strength = interaction_strength;
+        return param;
+    }
+
+    // pairs (including self pairs) within max_range, found by walking the cell list
+    std::size_t pairs_in_range(const dtks::ParticleSimulation & sim)
+    {
+        const auto & cell_list = sim.cell_list_;
+        const auto & particles = sim.particles_;
+        const float shape_x = float(sim.params_.shape[0]);
+        const float shape_y = float(sim.params_.shape[1]);
+        const float range_sq = float(sim.params_.max_range * sim.params_.max_range);
+
+        std::size_t n = 0;
+        for(std::size_t cell = 0; cell < cell_list.n_cells(); ++cell)
+        {
+            for(auto i = cell_list.cell_begin(cell); i < cell_list.cell_end(cell); ++i)
+            {
+                cell_list.for_each_neighbor_cell(cell, [&](std::size_t neighbor_cell)
+                {
+                    for(auto j = cell_list.cell_begin(neighbor_cell); j < cell_list.cell_end(neighbor_cell); ++j)
+                    {
+                        float dx = std::abs(particles.x[j] - particles.x[i]);
+                        float dy = std::abs(particles.y[j] - particles.y[i]);
+                        dx = std::min(dx, shape_x - dx);
+                        dy = std::min(dy, shape_y - dy);
+                        n += (dx*dx + dy*dy < range_sq);
+                    }
+                });
+            }
+        }
+        return n;
+    }
+
+    // max deviation from the brute force forces, relative to the largest force
+    float max_force_error(dtks::ParticleSimulation & sim)
+    {
+        const auto forces = sim.compute_forces();
+        const auto reference = sim.brute_force_forces();
+        float max_error = 0.0f;
+        float max_force = 1e-6f;
+        for(std::size_t d = 0; d < 2; ++d)
+        {
+            for(std::size_t i = 0; i < forces[d].size(); ++i)
+            {
+                max_error = std::max(max_error, std::abs(forces[d][i] - reference[d][i]));
+                max_force = std::max(max_force, std::abs(reference[d][i]));
+            }
+        }
+        return max_error / max_force;
+    }
+
+    // the built-in force curve of particle_life.cpp, to pass it as a custom one
+    float builtin_curve(float r, float a)
+    {
+        const float beta = 0.3f;
+        if(r < beta) {
+            return r / beta - 1.0f;
+        }
+        else if(beta < r && r < 1.0f) {
+            return a * (1.0f - std::abs(2.0f * r - 1.0f - beta) / (1.0f - beta));
+        }
+        else {
+            return 0.0f;
+        }
+    }
+
+    bool same_forces(const std::array<std::vector<float>, 2> & a, const std::array<std::vector<float>, 2> & b)
+    {
+        return a[0] == b[0] && a[1] == b[1];
+    }
+
+    // brute force forces with the core of the force table: below the first
+    // sample, dist = max_range / sqrt(n_samples), the force is the one at that
+    // distance scaled down linearly to zero
+    std::array<std::vector<float>, 2> softened_forces(const dtks::ParticleSimulation & sim, std::size_t n_samples)
+    {
+        const auto & particles = sim.particles_;
+        const float range = float(sim.params_.max_range);
+        const float shape_x = float(sim.params_.shape[0]);
+        const float shape_y = float(sim.params_.shape[1]);
+        const float core = range / std::sqrt(float(n_samples));
+        const auto n = particles.size();
+        std::array<std::vector<float>, 2> forces = {std::vector<float>(n, 0.0f), std::vector<float>(n, 0.0f)};
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            for(std::size_t j = 0; j < n; ++j)
+            {
+                float diff_x = particles.x[j] - particles.x[i];
+                float diff_y = particles.y[j] - particles.y[i];
+                diff_x -= shape_x * std::round(diff_x / shape_x);
+                diff_y -= shape_y * std::round(diff_y / shape_y);
+                const float dist = std::sqrt(diff_x * diff_x + diff_y * diff_y);
+                if(i == j || dist >= range)
+                {
+                    continue;
+                }
+                const float strength = sim.params_.interaction_strength(particles.type[i], particles.type[j]);
+                const float r = std::max(dist, core);
+                const float h = builtin_curve(r / range, strength) * range / r;
+                forces[0][i] += h * diff_x;
+                forces[1][i] += h * diff_y;
+            }
+        }
+        return forces;
+    }
+
+    // the force table interpolates linearly in d^2, so besides the softened core
+    // (see softened_forces) its forces may differ from the exact curve by 2%
+    // of the largest force. A custom copy of the built-in curve must give
+    // exactly the forces of the built-in table
+    int check_force_table()
+    {
+        const float tolerance = 2e-2f;
+        int n_failed = 0;
+        for(const auto & shape : {std::array<int, 2>{150, 90}, std::array<int, 2>{512, 384}})
+        {
+            for(std::size_t table_size : {256, 1024, 4096})
+            {
+                for(bool custom_curve : {false, true})
+                {
+                    for(auto simd_level : {dtks::SimdLevel::none, dtks::SimdLevel::automatic})
+                    {
+                        for(std::size_t n_threads : {1, 3})
+                        {
+                            auto param = make_parameters(40);
+                            param.shape = shape;
+                            param.simd_level = simd_level;
+                            param.n_threads = n_threads;
+                            param.force_table_size = table_size;
+                            if(custom_curve)
+                            {
+                                param.force_curve = builtin_curve;
+                            }
+                            dtks::ParticleSimulation sim(param);
+                            for(int i = 0; i < 5; ++i)
+                            {
+                                sim.step();
+                            }
+                            const auto forces = sim.compute_forces();
+                            const auto reference = softened_forces(sim, table_size);
+                            float error = 0.0f;
+                            float max_force = 1e-6f;
+                            for(std::size_t d = 0; d < 2; ++d)
+                            {
+                                for(std::size_t i = 0; i < forces[d].size(); ++i)
+                                {
+                                    error = std::max(error, std::abs(forces[d][i] - reference[d][i]));
+                                    max_force = std::max(max_force, std::abs(reference[d][i]));
+                                }
+                            }
+                            error /= max_force;
+                            bool ok = error < tolerance;
+                            // the custom copy of the built-in curve gives the same table
+                            if(custom_curve)
+                            {
+                                param.force_curve = nullptr;
+                                dtks::ParticleSimulation builtin(param);
+                                for(int i = 0; i < 5; ++i)
+                                {
+                                    builtin.step();
+                                }
+                                ok = ok && same_forces(sim.compute_forces(), builtin.compute_forces());
+                            }
+                            n_failed += !ok;
+                            if(!ok)
+                            {
+                                std::cout<<"FAILED force table "<<table_size<<(custom_curve ? " custom curve" : "")
+                                    <<" shape "<<shape[0]<<"x"<<shape[1]
+                                    <<" simd "<<dtks::simd_level_name(simd_level)
+                                    <<" threads "<<n_threads<<" relative error "<<error<<"\n";
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return n_failed;
+    }
+
+    int check()
+    {
+        const std::array<int, 2> shapes[] = {
+            {100, 100},     // a single cell
+            {150, 90},      // 2 x 1 cells, the 3x3 block wraps onto itself
+            {200, 130},     // not a multiple of max_range
+            {1000, 37},     // long and thin
+            {512, 384}
+        };
+        int n_failed = 0;
+        for(const auto & shape : shapes)
+        {
+            for(int subdivision = 1; subdivision <= 3; ++subdivision)
+            {
+                for(float skin : {0.0f, 8.0f})
+                {
+                    for(auto simd_level : {dtks::SimdLevel::none, dtks::SimdLevel::automatic})
+                    {
+                        for(std::size_t n_threads : {1, 3})
+                        {
+                            auto param = make_parameters(40);
+                            param.shape = shape;
+                            param.cell_subdivision = subdivision;
+                            param.verlet_skin = skin;
+                            param.simd_level = simd_level;
+                            param.n_threads = n_threads;
+                            dtks::ParticleSimulation sim(param);
+                            // a few steps to build up clusters, then compare
+                            for(int i = 0; i < 5; ++i)
+                            {
+                                sim.step();
+                            }
+                            const auto error = max_force_error(sim);
+                            const bool ok = error < 1e-4f;
+                            n_failed += !ok;
+                            if(!ok)
+                            {
+                                std::cout<<"FAILED shape "<<shape[0]<<"x"<<shape[1]
+                                    <<" subdivision "<<subdivision<<" skin "<<skin
+                                    <<" simd "<<dtks::simd_level_name(simd_level)
+                                    <<" threads "<<n_threads<<" relative error "<<error<<"\n";
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        n_failed += check_force_table();
+        std::cout<<(n_failed == 0 ? "all force checks passed" : "force checks failed")<<"\n";
+        return n_failed == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return check();
+    }
+
+    std::size_t n_particles_per_type = 2000;
+    std::size_t n_steps = 50;
+    if(!dtks::parse_counts(argc, argv, "particle_life_bench [n_particles_per_type] [n_steps] | --check", n_particles_per_type, n_steps))
+    {
+        return 2;
+    }
+
+    for(int subdivision = 1; subdivision <= 3; ++subdivision)
+    {
+        auto param = make_parameters(n_particles_per_type);
+        param.cell_subdivision = subdivision;
+        dtks::ParticleSimulation sim(param);
+
+        // let the initial uniform distribution form clusters first
+        for(std::size_t i=0; i<n_steps; ++i)
+        {
+            sim.step();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        for(std::size_t i=0; i<n_steps; ++i)
+        {
+            sim.step();
+        }
+        const auto stop = std::chrono::steady_clock::now();
+
+        const double n_particles = double(sim.particles_.size());
+        const auto candidates = sim.cell_list_.candidate_pairs();
+        const auto in_range = pairs_in_range(sim);
+        std::cout<<"subdivision "<<subdivision
+            <<"  grid "<<sim.cell_list_.shape()[0]<<"x"<<sim.cell_list_.shape()[1]
+            <<"  kernel "<<dtks::simd_level_name(sim.simd_level_used())
+            <<"  stencil cells "<<sim.cell_list_.stencil().size()
+            <<"  candidates / particle "<<double(candidates) / n_particles
+            <<"  in range / particle "<<double(in_range) / n_particles
+            <<"  hit rate "<<double(in_range) / double(candidates)
+            <<"  ms / step "<<std::chrono::duration<double, std::milli>(stop - start).count() / double(n_steps)
+            <<"\n";
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace dtks{
+
+    // Philox4x32-10 counter based random number generator (Salmon et al., "Parallel
+    // random numbers: as easy as 1, 2, 3", SC 2011).
+    // The output is a pure function of (seed, stream, substream, position), so
+    // independent streams, e.g. one per (step, ant), can be created anywhere without
+    // any shared state. Satisfies UniformRandomBitGenerator.
+    class Philox4x32
+    {
+        public:
+        using result_type = std::uint32_t;
+
+        Philox4x32(std::uint64_t seed, std::uint64_t stream = 0, std::uint32_t substream = 0)
+        :   key_{std::uint32_t(seed), std::uint32_t(seed >> 32)},
+            counter_{0, substream, std::uint32_t(stream), std::uint32_t(stream >> 32)}
+        {
+        }
+
+        static constexpr result_type min()
+        {
+            return 0;
+        }
+
+        static constexpr result_type max()
+        {
+            return std::numeric_limits<result_type>::max();
+        }
+
+        result_type operator()()
+        {
+            if(index_ == 4)
+            {
+                block_ = generate(counter_, key_);
+                ++counter_[0];
+                index_ = 0;
+            }
+            return block_[index_++];
+        }
+
+        // the 10 round bijection of one counter block
+        static std::array<std::uint32_t, 4> generate(std::array<std::uint32_t, 4> counter, std::array<std::uint32_t, 2> key)
+        {
+            for(int round = 0; round < 10; ++round)
+            {
+                const std::uint64_t product0 = std::uint64_t(0xD2511F53u) * counter[0];
+                const std::uint64_t product1 = std::uint64_t(0xCD9E8D57u) * counter[2];
+                counter = {
+                    std::uint32_t(product1 >> 32) ^ counter[1] ^ key[0],
+                    std::uint32_t(product1),
+                    std::uint32_t(product0 >> 32) ^ counter[3] ^ key[1],
+                    std::uint32_t(product0)
+                };
+                key[0] += 0x9E3779B9u;
+                key[1] += 0xBB67AE85u;
+            }
+            return counter;
+        }
+
+        private:
+        std::array<std::uint32_t, 2> key_;
+        std::array<std::uint32_t, 4> counter_;
+        std::array<std::uint32_t, 4> block_ = {0, 0, 0, 0};
+        int index_ = 4;
+    };
+
+} // namespace dtks
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <random>
+
+namespace dtks{
+
+    // draws index i of three with probability weights[i] / sum(weights), without the
+    // heap allocation and normalisation of a std::discrete_distribution per draw.
+    // It consumes the same random numbers and uses the same cumulative thresholds as
+    // libstdc++'s discrete_distribution (one generate_canonical<double>, first
+    // threshold >= u), so with libstdc++ it picks exactly the same index.
+    // Negative weights must be clamped by the caller, all zero weights yield 0.
+    template<class WEIGHTS, class RNG>
+    inline int sample_one_of_three(const WEIGHTS & weights, RNG & generator)
+    {
+        const double w0 = weights[0];
+        const double w1 = weights[1];
+        const double w2 = weights[2];
+        const double sum = w0 + w1 + w2;
+        const double u = std::generate_canonical<double, std::numeric_limits<double>::digits>(generator);
+        if(!(sum > 0.0))
+        {
+            return 0;
+        }
+        const double threshold_0 = w0 / sum;
+        const double threshold_1 = threshold_0 + w1 / sum;
+        return int(u > threshold_0) + int(u > threshold_1);
+    }
+
+} // namespace dtks
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "aligned_allocator.hpp"
+#include "image_view.hpp"
+
+namespace dtks{
+
+    // reusable memory for the temporary images of the image operations.
+    // Each slot keeps its buffer between calls, so repeated calls on images of
+    // the same size do not allocate (nor fault in fresh pages) again
+    class ScratchArena
+    {
+        public:
+
+        // an image of the given shape over the buffer of slot, with undefined
+        // pixels. Valid until the slot is requested again or release() is called
+        template<class T>
+        ImageView2d<T> image(std::size_t slot, std::array<int, 2> shape)
+        {
+            static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+                "scratch images hold plain pixel types");
+            if(slot >= buffers_.size())
+            {
+                buffers_.resize(slot + 1);
+            }
+            auto & buffer = buffers_[slot];
+            const auto bytes = std::size_t(shape[0]) * std::size_t(shape[1]) * sizeof(T);
+            if(buffer.size() < bytes)
+            {
+                // drop the old buffer first, its content does not need to be kept
+                buffer = Buffer();
+                buffer.resize(bytes);
+            }
+            return ImageView2d<T>(reinterpret_cast<T *>(buffer.data()), shape);
+        }
+
+        // frees the buffers of all slots
+        void release()
+        {
+            buffers_.clear();
+        }
+
+        std::size_t capacity_bytes() const
+        {
+            std::size_t bytes = 0;
+            for(const auto & buffer : buffers_)
+            {
+                bytes += buffer.size();
+            }
+            return bytes;
+        }
+
+        private:
+        using Buffer = std::vector<std::byte, AlignedAllocator<std::byte>>;
+        std::vector<Buffer> buffers_;
+    };
+
+    // the arena of the calling thread, used by the operations of image.hpp.
+    // It holds on to the largest temporaries seen so far, scratch_arena().release()
+    // returns them
+    inline ScratchArena & scratch_arena()
+    {
+        thread_local ScratchArena arena;
+        return arena;
+    }
+
+} // namespace dtks
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dtks{
+
+    // minimal fork-join thread pool.
+    // parallel_for splits [begin, end) into chunks of `grain` elements which are
+    // handed out dynamically to the workers and the calling thread. The call blocks
+    // until all chunks are done. Calls from different threads are serialized,
+    // nested calls from inside a chunk are not supported.
+    class ThreadPool
+    {
+        public:
+
+        // n_threads counts the calling thread, 0 means std::thread::hardware_concurrency()
+        explicit ThreadPool(std::size_t n_threads = 0)
+        {
+            if(n_threads == 0)
+            {
+                n_threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+            }
+            workers_.reserve(n_threads - 1);
+            for(std::size_t i = 1; i < n_threads; ++i)
+            {
+                workers_.emplace_back([this]{ worker_loop(); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wake_.notify_all();
+            for(auto & worker : workers_)
+            {
+                worker.join();
+            }
+        }
+
+        // number of threads working on a parallel_for, including the caller
+        std::size_t size() const
+        {
+            return workers_.size() + 1;
+        }
+
+        // f(chunk_begin, chunk_end)
+        template<class F>
+        void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F && f)
+        {
+            if(begin >= end)
+            {
+                return;
+            }
+            grain = std::max<std::size_t>(grain, 1);
+            if(workers_.empty() || end - begin <= grain)
+            {
+                f(begin, end);
+                return;
+            }
+
+            std::lock_guard<std::mutex> submit_lock(submit_mutex_);
+            task_ = [&](std::size_t chunk_begin, std::size_t chunk_end){ f(chunk_begin, chunk_end); };
+            task_end_ = end;
+            task_grain_ = grain;
+            next_.store(begin);
+            error_ = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                busy_ = workers_.size();
+                ++generation_;
+            }
+            wake_.notify_all();
+
+            run_chunks();
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                done_.wait(lock, [this]{ return busy_ == 0; });
+            }
+            task_ = nullptr;
+            if(error_)
+            {
+                std::rethrow_exception(error_);
+            }
+        }
+
+        // parallel_for with a grain size giving a few chunks per thread
+        template<class F>
+        void parallel_for(std::size_t begin, std::size_t end, F && f)
+        {
+            const auto n_chunks = size() * 4;
+            parallel_for(begin, end, (end - begin + n_chunks - 1) / n_chunks, std::forward<F>(f));
+        }
+
+        private:
+
+        void run_chunks()
+        {
+            while(true)
+            {
+                const auto chunk_begin = next_.fetch_add(task_grain_);
+                if(chunk_begin >= task_end_)
+                {
+                    break;
+                }
+                const auto chunk_end = std::min(chunk_begin + task_grain_, task_end_);
+                try
+                {
+                    task_(chunk_begin, chunk_end);
+                }
+                catch(...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if(!error_)
+                    {
+                        error_ = std::current_exception();
+                    }
+                }
+            }
+        }
+
+        void worker_loop()
+        {
+            std::size_t seen_generation = 0;
+            while(true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wake_.wait(lock, [&]{ return stop_ || generation_ != seen_generation; });
+                    if(stop_)
+                    {
+                        return;
+                    }
+                    seen_generation = generation_;
+                }
+
+                run_chunks();
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if(--busy_ == 0)
+                    {
+                        done_.notify_one();
+                    }
+                }
+            }
+        }
+
+        std::vector<std::thread> workers_;
+
+        std::mutex submit_mutex_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        bool stop_ = false;
+        std::size_t generation_ = 0;
+        std::size_t busy_ = 0;
+
+        std::function<void(std::size_t, std::size_t)> task_;
+        std::size_t task_end_ = 0;
+        std::size_t task_grain_ = 1;
+        std::atomic<std::size_t> next_{0};
+        std::exception_ptr error_;
+    };
+
+} // namespace dtks
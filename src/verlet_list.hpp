@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "cell_list.hpp"
+
+namespace dtks{
+
+    // verlet neighbor list on a periodic 2d domain.
+    // The neighbors of point i are indices()[begin(i)] ... indices()[end(i) - 1]:
+    // all points closer than the cutoff (interaction range + skin) when the list
+    // was built. The list stays valid until some point moved further than skin / 2
+    // from its position at build time, which needs_rebuild() checks.
+    class VerletList
+    {
+        public:
+
+        VerletList() = default;
+
+        inline std::size_t begin(std::size_t i) const
+        {
+            return start_[i];
+        }
+
+        inline std::size_t end(std::size_t i) const
+        {
+            return start_[i + 1];
+        }
+
+        const std::vector<std::uint32_t>& indices() const
+        {
+            return indices_;
+        }
+
+        // cell_list must be built for the current positions with cells at least
+        // `cutoff` wide. With half == true only neighbors j < i are stored, which is
+        // enough if each pair is evaluated once.
+        // for_each_chunk(n, f) calls f(begin, end) on chunks of [0, n), possibly in parallel
+        template<class FOR_EACH_CHUNK>
+        void build(
+            const CellList & cell_list,
+            const float * x,
+            const float * y,
+            std::size_t n,
+            float cutoff,
+            std::array<float, 2> shape,
+            bool half,
+            FOR_EACH_CHUNK && for_each_chunk
+        )
+        {
+            const float cutoff_sq = cutoff * cutoff;
+            start_.resize(n + 1);
+            x0_.assign(x, x + n);
+            y0_.assign(y, y + n);
+
+            // visit(i, f) calls f(j) for each neighbor j of i
+            auto visit = [&](std::size_t i, auto && f)
+            {
+                cell_list.for_each_neighbor_cell(cell_list.cell_index(x[i], y[i]), [&](std::size_t neighbor_cell)
+                {
+                    const auto neighbor_end = half ? std::min(cell_list.cell_end(neighbor_cell), i) : cell_list.cell_end(neighbor_cell);
+                    for(auto j = cell_list.cell_begin(neighbor_cell); j < neighbor_end; ++j)
+                    {
+                        if(j != i && minimum_image_dist_sq(x[j] - x[i], y[j] - y[i], shape) < cutoff_sq)
+                        {
+                            f(j);
+                        }
+                    }
+                });
+            };
+
+            // count, prefix sum, fill. Points are processed independently,
+            // so both passes can run in parallel
+            for_each_chunk(n, [&](std::size_t chunk_begin, std::size_t chunk_end)
+            {
+                for(std::size_t i = chunk_begin; i < chunk_end; ++i)
+                {
+                    std::uint32_t count = 0;
+                    visit(i, [&](std::size_t){ ++count; });
+                    start_[i + 1] = count;
+                }
+            });
+            start_[0] = 0;
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                start_[i + 1] += start_[i];
+            }
+            indices_.resize(start_[n]);
+            for_each_chunk(n, [&](std::size_t chunk_begin, std::size_t chunk_end)
+            {
+                for(std::size_t i = chunk_begin; i < chunk_end; ++i)
+                {
+                    auto out = indices_.data() + start_[i];
+                    visit(i, [&](std::size_t j){ *out++ = static_cast<std::uint32_t>(j); });
+                }
+            });
+        }
+
+        // did any point move more than skin / 2 since the last build?
+        template<class FOR_EACH_CHUNK>
+        bool needs_rebuild(
+            const float * x,
+            const float * y,
+            std::size_t n,
+            float skin,
+            std::array<float, 2> shape,
+            FOR_EACH_CHUNK && for_each_chunk
+        ) const
+        {
+            if(x0_.size() != n)
+            {
+                return true;
+            }
+            const float max_dist_sq = 0.25f * skin * skin;
+            std::atomic<bool> moved(false);
+            for_each_chunk(n, [&](std::size_t chunk_begin, std::size_t chunk_end)
+            {
+                for(std::size_t i = chunk_begin; i < chunk_end; ++i)
+                {
+                    if(minimum_image_dist_sq(x[i] - x0_[i], y[i] - y0_[i], shape) > max_dist_sq)
+                    {
+                        moved.store(true, std::memory_order_relaxed);
+                        return;
+                    }
+                }
+            });
+            return moved.load();
+        }
+
+        private:
+
+        static inline float minimum_image_dist_sq(float dx, float dy, const std::array<float, 2> & shape)
+        {
+            if(dx > shape[0] / 2.0f)
+                dx -= shape[0];
+            else if(dx < -shape[0] / 2.0f)
+                dx += shape[0];
+            if(dy > shape[1] / 2.0f)
+                dy -= shape[1];
+            else if(dy < -shape[1] / 2.0f)
+                dy += shape[1];
+            return dx*dx + dy*dy;
+        }
+
+        std::vector<std::uint32_t> start_;
+        std::vector<std::uint32_t> indices_;
+        std::vector<float> x0_;
+        std::vector<float> y0_;
+    };
+
+} // namespace dtks